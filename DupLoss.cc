@@ -25,29 +25,38 @@ float WEIGHTED_RECON_COST = 0;
 #include "rmq.h"
 #include "rmq.c"
 #include "common.h"
+#include "random.h"
 #include "argument.h"
 #include "input.h"
 #include "node.h"
 #include "tree.h"
+#include "threadpool.h"
+#include "rooting.h"
 
 namespace buildtree {
 //#include "buildtree-treeset-random.h"
 #include "buildtree-treeset-leafadd.h"
 #include "heuristic-leafadd.h"
 #include "buildtree-heuristicsecondfast.h"
+#include "buildtree-leafadd-parallel.h"
 //#include "buildtree-heuristicsecond.h"
 }
 
 namespace gtpspr {
 #include "gtp-spr-treeset.h"
 #include "gtp-spr-heuristic.h"
+#include "gtp-spr-parallel.h"
+#include "gtp-spr-processes.h"
 #include "gtp-spr-simpleheuristicrandom.h"
 }
 
+#include "multirun.h"
+
 
 namespace genedupreport {
 #include "report-treeset.h"
 #include "report.h"
+#include "report-parallel.h"
 }
 
 
@@ -62,8 +71,9 @@ int main(int argc, char *argsv[]) {
 	{
 		const Argument *arg = Argument::find("--seed");
 		if (arg != NULL) arg->convert(randomseed);
-		srand(randomseed);
 	}
+	// random number generator of the search (--runs and --islands give every run its own)
+	Random random(randomseed);
 
 
 
@@ -73,7 +83,7 @@ int main(int argc, char *argsv[]) {
 	// report
 	bool report_flag = true;
 
-	ReRoot reroot;
+	ReRoot reroot = OPT;
 
 	// output format
 	Format oformat;
@@ -122,6 +132,127 @@ int main(int argc, char *argsv[]) {
 		else arg->convert(generator);
 	}
 
+	// number of threads used to score the gene trees
+	int numthreads = 0;
+	{
+		const Argument *arg = Argument::find("--threads");
+		if (arg != NULL) {
+			arg->convert(numthreads);
+			if (numthreads < 1) EXCEPTION("--threads needs a positive number");
+		}
+	}
+
+	// what the threads work on: the gene trees of one prune candidate or whole prune candidates
+	Parallel parallel = GENETREES;
+	{
+		const Argument *arg = Argument::find("--parallel");
+		if (arg != NULL) {
+			string str;
+			arg->convert(str);
+			if (str == "genetrees") parallel = GENETREES;
+			else
+			if (str == "candidates") parallel = CANDIDATES;
+			else EXCEPTION("--parallel has a wrong argument");
+		}
+	}
+
+	// number of independent runs (each with its own initial species tree and local search)
+	int numruns = 0;
+	{
+		const Argument *arg = Argument::find("--runs");
+		if (arg != NULL) {
+			arg->convert(numruns);
+			if (numruns < 1) EXCEPTION("--runs needs a positive number");
+			if (Argument::find("--parallel") != NULL) WARNING("--parallel does not apply to --runs (the threads work on whole runs)");
+		}
+	}
+
+	// island search: the runs exchange their best species tree
+	int numislands = 0;
+	{
+		const Argument *arg = Argument::find("--islands");
+		if (arg != NULL) {
+			arg->convert(numislands);
+			if (numislands < 1) EXCEPTION("--islands needs a positive number");
+			if (numruns > 0) EXCEPTION("--islands cannot be combined with --runs");
+			if (Argument::find("--parallel") != NULL) WARNING("--parallel does not apply to --islands (every island has its own thread)");
+			numruns = numislands;
+		}
+	}
+
+	// number of worker processes that score a share of the gene trees each
+	int numprocesses = 0;
+	{
+		const Argument *arg = Argument::find("--processes");
+		if (arg != NULL) {
+			arg->convert(numprocesses);
+			if (numprocesses < 1) EXCEPTION("--processes needs a positive number");
+			if (numthreads > 0) EXCEPTION("--processes cannot be combined with --threads");
+			if (numruns > 0) EXCEPTION("--processes cannot be combined with --runs or --islands");
+		}
+	}
+
+	// regraft positions of the rSPR rounds within the given number of edges of the prune point (0 = all)
+	int sprradius = 0;
+	{
+		const Argument *arg = Argument::find("--spr-radius");
+		if (arg != NULL) {
+			arg->convert(sprradius);
+			if (sprradius < 1) EXCEPTION("--spr-radius needs a positive number");
+		}
+	}
+
+	// first-improvement rounds: commit the best move of the first K prune candidates that improve the species tree
+	int firstimprove = 0;
+	{
+		const Argument *arg = Argument::find("--first-improvement");
+		if (arg != NULL) {
+			firstimprove = 1;
+			if (arg->hasValue()) arg->convert(firstimprove);
+			if (firstimprove < 1) EXCEPTION("--first-improvement needs a positive number");
+		}
+	}
+
+	// how the gene trees of an rSPR prune candidate are scored: every tree walks the species tree on its own
+	// or the trees share the walks
+	Engine engine = TREES;
+	{
+		const Argument *arg = Argument::find("--spr-engine");
+		if (arg != NULL) {
+			string str;
+			arg->convert(str);
+			if (str == "trees") engine = TREES;
+			else
+			if (str == "sweep") engine = SWEEP;
+			else EXCEPTION("--spr-engine has a wrong argument");
+		}
+	}
+
+	// when the search looks for the best rooting of the unrooted gene trees again
+	RootSchedule rootschedule = ROOT_EACH;
+	int rootevery = 1;
+	{
+		const Argument *arg = Argument::find("--rooting");
+		if (arg != NULL) {
+			string str;
+			arg->convert(str);
+			if (str == "each") rootschedule = ROOT_EACH;
+			else
+			if (str == "converged") rootschedule = ROOT_CONVERGED;
+			else
+			if (str == "changed") rootschedule = ROOT_CHANGED;
+			else {
+				rootschedule = ROOT_EVERY;
+				arg->convert(rootevery);
+				if (rootevery < 1) EXCEPTION("--rooting has a wrong argument");
+			}
+		}
+	}
+
+	// the leaf adding heuristic inserts the best of all remaining leaves in every step
+	const bool greedy = Argument::find("--greedy") != NULL;
+	if (greedy && (generator != 1)) WARNING("--greedy only applies to generator 1");
+
 	// puts the leaf add into fast mode
 	bool fastFlag = true;
 
@@ -143,6 +274,7 @@ int main(int argc, char *argsv[]) {
 	}
 
 	#include "commonarguments.cc"
+	input.random = &random;
 
 	// output help message
 	if (helpFlag) {
@@ -155,7 +287,34 @@ int main(int argc, char *argsv[]) {
 		cout << "                                0 - use user-provided species tree as initial species tree" << endl;
 		cout << "                                1 - use leaf adding heuristic to build initial species tree [default]" << endl;
 		cout << "      --constraints <file>      A file containing groupings of species for generator 1." << endl;
+		cout << "      --greedy                  Generator 1 scores all remaining species in every step and adds the best one" << endl;
+		cout << "                                (instead of a random one); --threads score the species concurrently" << endl;
 		cout << "      --limit                   Limit species tree to leaf set of gene tree when computing losses. Not recommended." << endl;
+		cout << "      --threads <number>        Score the gene trees with the given number of threads (also in the final report)." << endl;
+		cout << "      --parallel genetrees|candidates  Threads share the gene trees of one rSPR candidate [default]" << endl;
+		cout << "                                or evaluate whole rSPR prune candidates (more memory, coarser tasks)" << endl;
+		cout << "      --processes <number>      Score the gene trees with the given number of local worker processes, each holding" << endl;
+		cout << "                                a share of the gene trees (same result as a single process)" << endl;
+		cout << "      --runs <number>           Number of independent runs (initial species tree + local search) with the" << endl;
+		cout << "                                seeds seed, seed+1, ...; the input is read once, --threads runs work concurrently" << endl;
+		cout << "                                and the best species tree is reported together with a table of all runs" << endl;
+		cout << "      --islands <number>        Like --runs, but the runs work at the same time (one thread each) and" << endl;
+		cout << "                                continue from the best species tree of all runs when they get stuck and it" << endl;
+		cout << "                                beats their own" << endl;
+		cout << "      --spr-radius <edges>      rSPR rounds only score and try the regraft positions within the given number of" << endl;
+		cout << "                                edges of the pruned subtree (the gene tree mappings are still computed in full);" << endl;
+		cout << "                                all positions are tried once no better tree is found this way" << endl;
+		cout << "      --first-improvement [K]   rSPR rounds visit the prune candidates in random order and apply the best move" << endl;
+		cout << "                                of the first K candidates that improve the species tree [default K 1]; the" << endl;
+		cout << "                                search returns to full rounds when improvements become rare" << endl;
+		cout << "      --spr-engine trees|sweep  Every gene tree walks the species tree for each rSPR prune candidate [default]" << endl;
+		cout << "                                or the gene trees of a candidate with the same weight share the walks (same" << endl;
+		cout << "                                scores); rerooted unrooted trees keep their own walks and non-integer weights" << endl;
+		cout << "                                fall back to one walk per gene tree" << endl;
+		cout << "      --rooting each|converged|changed|<K>  Find the best rooting of the unrooted gene trees after every" << endl;
+		cout << "                                rSPR operation [default], only when no better species tree is found, after" << endl;
+		cout << "                                every operation but only for the trees whose induced species tree has changed," << endl;
+		cout << "                                or after every K operations; the time spent is reported at the end" << endl;
 		cout << "  -q, --quiet                   No processing output." << endl;
 		cout << "      --seed <integer number>   Set a user defined random number generator seed." << endl;
 		cout << "  -v, --version                 Output the version number." << endl;
@@ -177,103 +336,174 @@ int main(int argc, char *argsv[]) {
 
 
 
-	// -------------------------------------------------------------------------------------------
-	// run tree generator
-	ostringstream ostreamBuildtree;
-	switch (generator) {
-		case 0: {
-				msgout << "Using user-provided initial species tree" << endl;
-		} break;
-		case 1: {
-			// copy input into a string
-			ostringstream ostreamTemp;
-			input.skipComments = false;
-			char ch;
-			while (input.nextChar(ch)) ostreamTemp << ch;
-			input.skipComments = true;
-			istringstream istreamBuildtree;
-			istreamBuildtree.str(ostreamTemp.str());
-			Input inputBuildtree(&istreamBuildtree);
-
-			buildtree::HeuristicLeafAdd *heuristic = NULL;
-//			if(fastFlag)
-//			{
-				msgout << "Using fast randomized leaf adding heuristic to build initial species tree" << endl;
-				heuristic = new buildtree::HeuristicSecondFast();
-
-				// read input trees
-				heuristic->readTrees(inputBuildtree);
-//			}
-
-
-			// read constraints
-			if (constraints_in!=NULL) {
-				Input constraints_input(constraints_in);
-				heuristic->readConstraints(constraints_input);
-			}
-
-			ReRoot reroot=OPT;
-			heuristic->run(ostreamBuildtree, reroot);
-
-			// output genetrees
-			ostreamBuildtree << ostreamTemp.str();
-			delete heuristic;
-		} break;
-
-		default: {
-			EXCEPTION("Unknown initial species tree generator " << generator);
-		} break;
-	}
-	// create input for next step - search step
-	istringstream istreamSearch;
-	istreamSearch.str(ostreamBuildtree.str());
-	Input inputSearch2(&istreamSearch);
-	Input &inputSearch = (generator==0) ? input : inputSearch2;
-
-	// -------------------------------------------------------------------------------------------
-	// run the search heuristic
 	ostringstream ostreamSearchSpeciesTree;
 	ostringstream ostreamSearchGeneTrees;
-	gtpspr::Heuristic *heuristic = NULL;
-
-
-// Commenting out different heuristic cases below since only going to use simple SPR search heuristic. 
-//	switch (heuristic_type) {
-//		case 1: {
-			msgout << "Using SPR local search heuristic to infer final species tree" << endl;
-			heuristic = new gtpspr::SimpleHeuristicRandom(oformat, score_flag);
-//		} break;
-//		case 2: {
-//			msgout << "Using partial queue based heuristic" << endl;
-//			heuristic = new gtpspr::AdvancedHeuristic(oformat, score_flag);
-//		} break;
-//		case 3: {
-//			msgout << "Using full queue based heuristic" << endl;
-//			heuristic = new gtpspr::BioHeuristic(queue, max_trees, oformat, score_flag);
-//		} break;
-//		default: {
-//			EXCEPTION("Unknown heuristic " << heuristic);
-//		} break;
-//	}
-
-	// read input trees
-	heuristic->readTrees(inputSearch);
-
-	// run timed
-	time_t startTime = time(NULL);
-	heuristic->run(ostreamSearchSpeciesTree, reroot);
-	time_t endTime = time(NULL);
+	time_t startTime, endTime;
+	MultiRun *multirun = NULL;
+	if (numruns > 0) {
+		// -------------------------------------------------------------------------------------------
+		// independent runs of tree generator and search heuristic on copies of the input trees
+		if (numislands > 0) msgout << "Running " << numruns << " island searches with seeds " << randomseed << " to " << randomseed + numruns - 1 << endl;
+		else msgout << "Running " << numruns << " independent searches with seeds " << randomseed << " to " << randomseed + numruns - 1 << endl;
+		buildtree::HeuristicLeafAdd *leafadd = NULL;
+		gtpspr::TreeSet *master = new gtpspr::TreeSet;
+		switch (generator) {
+			case 0: {
+				msgout << "Using user-provided initial species tree" << endl;
+				master->readTrees(input);
+			} break;
+			case 1: {
+				// copy input into a string
+				ostringstream ostreamTemp;
+				input.skipComments = false;
+				char ch;
+				while (input.nextChar(ch)) ostreamTemp << ch;
+				input.skipComments = true;
+				istringstream istreamBuildtree(ostreamTemp.str());
+				Input inputBuildtree(&istreamBuildtree);
+				inputBuildtree.random = &random;
+				istringstream istreamSearch(ostreamTemp.str());
+				Input inputSearch(&istreamSearch);
+				inputSearch.random = &random;
+
+				msgout << "Using " << (greedy ? "greedy" : "fast randomized") << " leaf adding heuristic to build initial species trees" << endl;
+				leafadd = new buildtree::HeuristicSecondFast();
+				leafadd->readTrees(inputBuildtree);
+				leafadd->setGreedy(greedy);
+				if (constraints_in!=NULL) {
+					Input constraints_input(constraints_in);
+					leafadd->readConstraints(constraints_input);
+				}
+				master->readGeneTrees(inputSearch);
+			} break;
+
+			default: {
+				EXCEPTION("Unknown initial species tree generator " << generator);
+			} break;
+		}
+		msgout << "Using SPR local search heuristic to infer final species trees" << endl;
+
+		// run timed
+		startTime = time(NULL);
+		multirun = new MultiRun(leafadd, master, reroot, oformat, score_flag);
+		if (numislands > 0) multirun->setIslands();
+		multirun->setRadius(sprradius);
+		multirun->setFirstImprovement(firstimprove);
+		multirun->setEngine(engine);
+		multirun->setRootSchedule(rootschedule, rootevery);
+		multirun->run(numruns, numthreads, randomseed);
+		endTime = time(NULL);
+
+		RunResult &best = multirun->results[multirun->best()];
+		ostreamSearchSpeciesTree << best.speciestree;
+		ostreamSearchGeneTrees << best.genetrees;
+		WEIGHTED_RECON_COST = best.score;
+		delete leafadd;
+		delete master;
+	} else {
+		// -------------------------------------------------------------------------------------------
+		// run tree generator
+		ostringstream ostreamBuildtree;
+		switch (generator) {
+			case 0: {
+					msgout << "Using user-provided initial species tree" << endl;
+			} break;
+			case 1: {
+				// copy input into a string
+				ostringstream ostreamTemp;
+				input.skipComments = false;
+				char ch;
+				while (input.nextChar(ch)) ostreamTemp << ch;
+				input.skipComments = true;
+				istringstream istreamBuildtree;
+				istreamBuildtree.str(ostreamTemp.str());
+				Input inputBuildtree(&istreamBuildtree);
+				inputBuildtree.random = &random;
+
+				buildtree::HeuristicLeafAdd *heuristic = NULL;
+	//			if(fastFlag)
+	//			{
+					msgout << "Using " << (greedy ? "greedy" : "fast randomized") << " leaf adding heuristic to build initial species tree" << endl;
+					heuristic = new buildtree::HeuristicSecondFast();
+
+					// read input trees
+					heuristic->readTrees(inputBuildtree);
+					heuristic->setGreedy(greedy, numthreads);
+					heuristic->setRandom(&random);
+	//			}
+
+
+				// read constraints
+				if (constraints_in!=NULL) {
+					Input constraints_input(constraints_in);
+					heuristic->readConstraints(constraints_input);
+				}
+
+				ReRoot reroot=OPT;
+				heuristic->run(ostreamBuildtree, reroot);
+
+				// output genetrees
+				ostreamBuildtree << ostreamTemp.str();
+				delete heuristic;
+			} break;
+
+			default: {
+				EXCEPTION("Unknown initial species tree generator " << generator);
+			} break;
+		}
+		// create input for next step - search step
+		istringstream istreamSearch;
+		istreamSearch.str(ostreamBuildtree.str());
+		Input inputSearch2(&istreamSearch);
+		inputSearch2.random = &random;
+		Input &inputSearch = (generator==0) ? input : inputSearch2;
+
+		// -------------------------------------------------------------------------------------------
+		// run the search heuristic
+		gtpspr::Heuristic *heuristic = NULL;
+
+
+	// Commenting out different heuristic cases below since only going to use simple SPR search heuristic. 
+	//	switch (heuristic_type) {
+	//		case 1: {
+				msgout << "Using SPR local search heuristic to infer final species tree" << endl;
+				heuristic = new gtpspr::SimpleHeuristicRandom(oformat, score_flag);
+	//		} break;
+	//		case 2: {
+	//			msgout << "Using partial queue based heuristic" << endl;
+	//			heuristic = new gtpspr::AdvancedHeuristic(oformat, score_flag);
+	//		} break;
+	//		case 3: {
+	//			msgout << "Using full queue based heuristic" << endl;
+	//			heuristic = new gtpspr::BioHeuristic(queue, max_trees, oformat, score_flag);
+	//		} break;
+	//		default: {
+	//			EXCEPTION("Unknown heuristic " << heuristic);
+	//		} break;
+	//	}
+
+		// read input trees
+		heuristic->readTrees(inputSearch);
+		if (numthreads > 0) heuristic->setThreads(numthreads, parallel);
+		if (numprocesses > 0) heuristic->setProcesses(numprocesses);
+		heuristic->setRadius(sprradius);
+		heuristic->setFirstImprovement(firstimprove);
+		heuristic->setEngine(engine);
+		heuristic->setRootSchedule(rootschedule, rootevery);
+		heuristic->setRandom(&random);
+
+		// run timed
+		startTime = time(NULL);
+		heuristic->run(ostreamSearchSpeciesTree, reroot);
+		endTime = time(NULL);
 
 	
- 	// output genetrees
-	for (int i = 0; i < heuristic->genetree_rooted.size(); i++) {
-		heuristic->genetree_rooted.at(i)->tree2newick(ostreamSearchGeneTrees); ostreamSearchGeneTrees << endl;
-	}
-	for (int i = 0; i < heuristic->genetree_unrooted.size(); i++) {
-		ostreamSearchGeneTrees << "[&U]"; heuristic->genetree_unrooted.at(i)->tree2newick(ostreamSearchGeneTrees); ostreamSearchGeneTrees << endl;
-	}
+	 	// output genetrees
+		writeGeneTrees(ostreamSearchGeneTrees, *heuristic);
+		WEIGHTED_RECON_COST = heuristic->getCurrentScore();
 
-	delete heuristic;
+		delete heuristic;
+	}
 
 	// timing
 	{
@@ -303,28 +533,27 @@ int main(int argc, char *argsv[]) {
 		if (oformat == NEXUS) {
 			*out << "#nexus" << endl;
 		}
-		// each set of species tree and gene trees
+		// each set of species tree and gene trees (several species trees are reported concurrently)
 		istringstream MyStream(ostreamSearchSpeciesTree.str());
-		int no=1;
-		for (string tree;getline(MyStream, tree);no++) {
+		vector<string> speciestrees;
+		for (string tree;getline(MyStream, tree);) speciestrees.push_back(tree);
+		const string genetrees = ostreamSearchGeneTrees.str();
+		genedupreport::ReportSet reports(speciestrees, genetrees, genetreesFlag, score_flag, oformat);
+		reports.run(numthreads);
+		for (int no=1; no<=reports.reports.size(); no++) {
 			if (no > 1) *out << endl;
-
-			ostringstream ostreamReport;
-			ostreamReport << tree << ostreamSearchGeneTrees.str();
-			istringstream istreamReport(ostreamReport.str());
-			Input inputReport(&istreamReport);
-
-			genedupreport::Report report;
-
-			// read input trees
-			report.readTrees(inputReport);
-
-			// create record
-			report.createReportInComment(*out, true, no, genetreesFlag, score_flag, oformat);
+			*out << reports.reports[no-1];
 		}
 		// footer
 		if (oformat == NEXUS) {
 		}
+
+		// table of all runs
+		if (multirun != NULL) {
+			*out << endl;
+			multirun->writeTable(*out);
+			delete multirun;
+		}
 	}
 
 
@@ -237,10 +237,10 @@ public:
 		msgout << "Leaf set size: " << leafSetSize <<endl;
 		msgout <<  "Building Starting triplet ... ";
 
-		index_extra = rand() % (leafSetSize-2);
+		index_extra = random->below(leafSetSize-2);
 
-		index_extra2 = index_extra+ 1 + (rand() % (leafSetSize - index_extra -2) );
-		index_extra3 = index_extra2 + 1 + (rand() % (leafSetSize - index_extra2 -1));
+		index_extra2 = index_extra+ 1 + (random->below(leafSetSize - index_extra -2) );
+		index_extra3 = index_extra2 + 1 + (random->below(leafSetSize - index_extra2 -1));
 
 		for (i= index_extra; i< index_extra + 1; i++)
 		{
@@ -331,7 +331,7 @@ public:
 		}
 
 
-		index = rand()%trip_queue.size();
+		index = random->below(trip_queue.size());
 
 		i= trip_queue[index].i_val;
 		l= trip_queue[index].l_val;
@@ -421,7 +421,7 @@ public:
 
 //speciestree->checkStructure();
 
-		index = rand()%queue.size();
+		index = random->below(queue.size());
 		old.BestNewLocation = queue[index].BestNewLocation;
 		speciestree->moveSubtree(speciestree->nodes[2], old.BestNewLocation);
 
@@ -473,8 +473,16 @@ public:
 
 
 		int nodeSetSize = nodes.size();
-		index_extra = rand()%leafSetSize;
-		for (i=index_extra; i< index_extra + 1; i++)
+		// leaves scored by the loop below (one random leaf, all leaves or none when threads do the greedy step)
+		int leaffirst = 0, leaflast = 0;
+		if (!greedy) {
+			index_extra = random->below(leafSetSize);
+			leaffirst = index_extra;
+			leaflast = index_extra + 1;
+		} else
+		if (numthreads > 0) scoreLeavesParallel(leafs, leafConstraint, leafpresent, rerooting);
+		else leaflast = leafSetSize;
+		for (i=leaffirst; i< leaflast; i++)
 		{
 
 			//build temporary tree by adding one leaf and check its scores
@@ -543,7 +551,7 @@ public:
 			// reconstruct the optimal species tree from queue data
 
 
-			index = rand()%queue.size();
+			index = random->below(queue.size());
 			NamedSpeciesNode *node1 = new NamedSpeciesNode(leafs[queue[index].BestSubtreeRoot]);
 
 			node1->constraint = leafConstraint[queue[index].BestSubtreeRoot];
@@ -616,6 +624,8 @@ public:
 		return Best_score;
 	}
 
+	void scoreLeavesParallel(vector<string> &leafs, int *leafConstraint, bool *leafpresent, const bool rerooting);
+
 };
 
 
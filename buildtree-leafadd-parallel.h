@@ -0,0 +1,168 @@
+/*
+Copyright (C) 2024 Mukul S. Bansal (mukul.bansal@uconn.edu).
+Based on open-source code originally written by Andre Wehe and
+Mukul S. Bansal for the DupTree software package.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BUILDTREE_LEAFADD_PARALLEL_H
+#define BUILDTREE_LEAFADD_PARALLEL_H
+
+#define TreeSet LEAFADD::TreeSet
+#define SpeciesNode LEAFADD::SpeciesNode
+#define NamedSpeciesNode LEAFADD::NamedSpeciesNode
+
+// ------------------------------------------------------------------------------------------------------------------
+// best insertion of one leaf into the current species tree
+struct LeafInsertion {
+	unsigned int score;
+	vector<int> nodes; // indices of all species nodes reaching the score (in the order the serial step meets them)
+};
+
+// ------------------------------------------------------------------------------------------------------------------
+// scores leaf insertions for a master heuristic on private copies of the species tree and the gene trees
+class LeafAddWorker : public HeuristicLeafAdd {
+public:
+	HeuristicLeafAdd *master;
+	unsigned int pass; // scoring step the species tree was last synchronized for
+	int currentconstraint;
+	LeafInsertion *result;
+
+	LeafAddWorker(HeuristicLeafAdd *master) : master(master) {
+		copyTrees(*master);
+		pass = 0;
+		result = NULL;
+	}
+
+	// take over the current species tree of the master (once per step)
+	void prepare() {
+		if (pass == master->pass) return;
+		speciestree->replicate(*master->speciestree);
+		pass = master->pass;
+	}
+
+	// add a leaf above the root, score all its positions and remove it again (same steps as the serial step)
+	void scoreLeaf(const string &name, const int constraint, const int currentconstraint, const bool rerooting, LeafInsertion &result) {
+		prepare();
+		this->currentconstraint = currentconstraint;
+		this->result = &result;
+		result.score = ~0;
+		result.nodes.clear();
+
+		NamedSpeciesNode *leaf = new NamedSpeciesNode(name);
+		leaf->constraint = constraint;
+		SpeciesNode *node = new SpeciesNode();
+		node->child(0) = leaf;
+		node->child(1) = speciestree->root;
+		node->child(0)->parent() = node;
+		node->child(1)->parent() = node;
+		if (node->child(0)->constraint == node->child(1)->constraint)
+			node->constraint = node->child(0)->constraint;
+		else node->constraint = -1;
+		speciestree->nodes.push_back(leaf);
+		speciestree->leafnodes.push_back(leaf);
+		speciestree->nodes.push_back(node);
+		speciestree->root = node;
+
+		createLeafMapping();
+		computeGeneDuplications(leaf, rerooting);
+
+		speciestree->leafnodes.pop_back();
+		speciestree->nodes.pop_back();
+		speciestree->nodes.pop_back();
+		speciestree->root = node->child(1);
+		speciestree->root->parent() = NULL;
+		delete leaf;
+		delete node;
+		this->result = NULL;
+	}
+
+	// keep the lowest score and all positions reaching it (with the arithmetic of HeuristicSecondFast::scoreComputed)
+	void scoreComputed(SpeciesNode &node) {
+		if ((node.constraint != currentconstraint) && (node.parent()->constraint != currentconstraint)) return;
+		const int &genedup = node.genedup;
+		const int &geneloss = node.lossScore;
+		const unsigned int score = genedup + geneloss; // the int sum, compared as unsigned like Best_score
+		if (score < result->score) {
+			result->score = score;
+			result->nodes.clear();
+		}
+		if (score == result->score) result->nodes.push_back(node.idx);
+	}
+
+	void run(ostream &, const ReRoot) {}
+};
+
+// ------------------------------------------------------------------------------------------------------------------
+// one greedy step (task i = remaining leaf i)
+class LeafAddTask : public ThreadTask {
+public:
+	HeuristicLeafAdd &master;
+	vector<string> &leafs;
+	int *leafConstraint;
+	vector<int> currentconstraint;
+	bool rerooting;
+	vector<LeafInsertion> &results;
+
+	LeafAddTask(HeuristicLeafAdd &master, vector<string> &leafs, int *leafConstraint, bool *leafpresent, const bool rerooting, vector<LeafInsertion> &results) :
+		master(master), leafs(leafs), leafConstraint(leafConstraint), rerooting(rerooting), results(results) {
+		// a constrained leaf has to stay with its group once a member of the group is in the tree
+		for (int i=0, last=leafs.size(); i<last; i++) {
+			const int c = leafConstraint[i];
+			currentconstraint.push_back(((c != -1) && leafpresent[c]) ? c : -1);
+		}
+	}
+
+	void process(const int task, const int worker) {
+		((LeafAddWorker*)master.workers[worker])->scoreLeaf(leafs[task], leafConstraint[task], currentconstraint[task], rerooting, results[task]);
+	}
+};
+
+// ------------------------------------------------------------------------------------------------------------------
+// score the best insertion of every remaining leaf with the thread pool and fill the queue with the overall best
+// the results are merged in leaf order, so the queue is the same as the one of the serial greedy step
+void HeuristicSecondFast::scoreLeavesParallel(vector<string> &leafs, int *leafConstraint, bool *leafpresent, const bool rerooting) {
+	if (threadpool == NULL) {
+		threadpool = new ThreadPool(numthreads);
+		for (int i=0; i<threadpool->size(); i++) workers.push_back(new LeafAddWorker(this));
+	}
+	speciestree->assignIndex();
+	pass++;
+	vector<LeafInsertion> results(leafs.size());
+	LeafAddTask task(*this, leafs, leafConstraint, leafpresent, rerooting, results);
+	threadpool->run(task, leafs.size());
+
+	for (int i=0, last=results.size(); i<last; i++) {
+		LeafInsertion &result = results[i];
+		if (result.nodes.empty()) continue;
+		if (result.score < Best_score) {
+			update = true;
+			queue.clear();
+			Best_score = result.score;
+		}
+		if (result.score != Best_score) continue;
+		for (int j=0, jlast=result.nodes.size(); j<jlast; j++) {
+			temp.BestSubtreeRoot = i;
+			temp.BestNewLocation = speciestree->nodes[result.nodes[j]];
+			queue.push_back(temp);
+		}
+	}
+}
+
+#undef TreeSet
+#undef SpeciesNode
+#undef NamedSpeciesNode
+
+#endif
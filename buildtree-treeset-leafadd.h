@@ -419,6 +419,32 @@ public:
 		for (int i = 0; i < nodes.size(); i++) nodes[i]->idx = i;
 	}
 
+	// take over a species tree that grows by appending nodes (node i is the copy of node i in src)
+	// the nodes src gained since the last call are created, topology and constraints are copied completely
+	// (the indices of src have to be assigned)
+	void replicate(SpeciesTree &src) {
+		for (int i = nodes.size(); i < src.nodes.size(); i++) {
+			SpeciesNode *node = src.nodes[i];
+			SpeciesNode *copy;
+			if (node->isLeaf()) {
+				NamedSpeciesNode *leaf = new NamedSpeciesNode(((NamedSpeciesNode*)node)->getName());
+				leafnodes.push_back(leaf);
+				copy = leaf;
+			} else copy = new SpeciesNode();
+			nodes.push_back(copy);
+		}
+		for (int i = 0; i < src.nodes.size(); i++) {
+			SpeciesNode *node = src.nodes[i];
+			SpeciesNode *copy = nodes[i];
+			copy->idx = i;
+			copy->constraint = node->constraint;
+			copy->parent() = node->parent() == NULL ? NULL : nodes[node->parent()->idx];
+			for (int j = 0; j < 2; j++)
+				copy->child(j) = node->child(j) == NULL ? NULL : nodes[node->child(j)->idx];
+		}
+		root = nodes[src.root->idx];
+	}
+
 	// node numbering + range of subtree
 	inline void establishOrder() {
 		int pos = 0;
@@ -536,6 +562,27 @@ public:
 	inline bool isRooted() {
 		return true;
 	}
+
+	// create a copy of another gene tree (node i is the copy of node i in src)
+	void replicate(GeneTreeRooted &src) {
+		map<GeneNodeRooted*, GeneNodeRooted*> copy;
+		copy[NULL] = NULL;
+		for (int i = 0; i < src.leafnodes.size(); i++) {
+			NamedGeneNodeRooted *leaf = new NamedGeneNodeRooted(src.leafnodes[i]->getName());
+			leafnodes.push_back(leaf);
+			copy[src.leafnodes[i]] = leaf;
+		}
+		for (int i = 0; i < src.nodes.size(); i++) {
+			if (copy.find(src.nodes[i]) == copy.end()) copy[src.nodes[i]] = new GeneNodeRooted();
+			nodes.push_back(copy[src.nodes[i]]);
+		}
+		for (int i = 0; i < src.nodes.size(); i++) {
+			GeneNodeRooted *node = src.nodes[i];
+			nodes[i]->parent() = copy[node->parent()];
+			for (int j = 0; j < 2; j++) nodes[i]->child(j) = copy[node->child(j)];
+		}
+		root = copy[src.root];
+	}
 };
 
 // a quasi unrooted binary gene tree
@@ -637,6 +684,18 @@ public:
 		msgout << genetree_rooted.size() + genetree_unrooted.size() << " input gene trees total" << endl;
 	}
 
+	// take over copies of the gene trees and constraints of another tree set (instead of readTrees)
+	void copyTrees(TreeSet &src) {
+		speciestree = new SpeciesTree;
+		if (!src.genetree_unrooted.empty()) EXCEPTION("copyTrees: unrooted gene trees are not supported");
+		for (int i=0; i<src.genetree_rooted.size(); i++) {
+			GeneTreeRooted *tree = new GeneTreeRooted;
+			tree->replicate(*src.genetree_rooted[i]);
+			genetree_rooted.push_back(tree);
+		}
+		constraints = src.constraints;
+	}
+
 	// ------------------------------------------------------------------------------------------------------
 	// read all constraints
 	vector< vector<string> > constraints;
@@ -22,6 +22,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <cstdlib>
 #include <ctime>
 #include <cctype>
+#include <cmath>
 
 #include <iostream>
 #include <istream>
@@ -32,10 +33,17 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <map>
 #include <set>
 #include <vector>
+#include <algorithm>
 #include <typeinfo>
 #include <list>
 #include <ctime>
+#include <mutex>
 #include <limits.h>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
 
 using namespace std;
 
@@ -116,3 +124,6 @@ void initialization(){
 
 enum ReRoot {ALL=1, OPT=0};
 enum Format {NEWICK, NEXUS};
+enum Parallel {GENETREES, CANDIDATES};
+enum Engine {TREES, SWEEP};
+enum RootSchedule {ROOT_EACH, ROOT_CONVERGED, ROOT_EVERY, ROOT_CHANGED};
@@ -20,6 +20,14 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef GTP_SPR_HEURISTIC_H
 #define GTP_SPR_HEURISTIC_H
 
+// ------------------------------------------------------------------------------------------------------------------
+// the best regraft positions of one prune candidate
+struct CandidateScore {
+	double score; // lowest score of all valid regraft positions
+	double genedup, geneloss;
+	vector<int> nodes; // indices of all regraft positions with the lowest score (in traversal order)
+};
+
 // ------------------------------------------------------------------------------------------------------------------
 class Heuristic : public TreeSet {
 public:
@@ -29,9 +37,32 @@ public:
 		#ifdef DEBUG
 		cout << "Heuristic created" << endl;
 		#endif
+		random = NULL;
+		numthreads = 0;
+		parallel = GENETREES;
+		threadpool = NULL;
+		pass = 0;
+		exactsums = true;
+		keepinitloss = false;
+		initloss = 0;
+		numprocesses = 0;
+		shardout = shardin = -1;
+		shardunrooted = 0;
+		costhits = costmisses = 0;
+		sprradius = radius = 0;
+		firstimprove = 0;
+		regraftepoch = 0;
+		engine = TREES;
+		rootschedule = ROOT_EACH;
+		rootevery = 1;
+		rootpasses = rootedtrees = keptrootings = 0;
+		roottime = 0;
 	}
 
 	virtual ~Heuristic() {
+		stopShards();
+		for (int i=0; i<workers.size(); i++) delete workers[i];
+		delete threadpool;
 		#ifdef DEBUG
 		cout << "Heuristic destroyed" << endl;
 		#endif
@@ -43,158 +74,319 @@ public:
 
 	inline void computeGeneDuplications(SpeciesNode *subtree, bool reroot = true) {
 		SpeciesNode *sibling = subtree->getSibling();
-		SpeciesNode *LossSibling;
+		if ((numthreads > 0) && (parallel == GENETREES)) {
+			computeGeneDuplicationsParallel(subtree, reroot);
+			forEachCallScoreComputed(subtree, sibling);
+			return;
+		}
 		speciestree->establishOrder();
 		speciestree->preprocessLCA();
+		createSubtreeSet(subtree);
 		resetGeneDuplications(sibling);
 		
 		//resetting stuff related to losses;
 		resetLossStuff(speciestree->root);
 
+		computeGeneDuplicationsTrees(genetree_rooted, genetree_unrooted, subtree, sibling, reroot);
+		speciestree->postprocessLCA();
+		
+		// 1 line of code to assign loss scores for non-relevant nodes.
+//		AssignLossScoresToNonRelevantNodes(sibling);		
+
+/*		// extra 1 line of code for losses
+//		AddLossCounterToDupScoreCounter(sibling);
+*/		
+//		outputSpeciesTreeNodes(speciestree->root);	
+//		cout << endl<< endl;
+		forEachCallScoreComputed(subtree, sibling);
+		
+	}
+
+	// add the gene duplications and losses of the given gene trees to the scores of the species nodes
+	void computeGeneDuplicationsTrees(vector<GeneTreeRooted*> &rooted, vector<GeneTreeUnrooted*> &unrooted, SpeciesNode *subtree, SpeciesNode *sibling, const bool reroot) {
+		if ((engine == SWEEP) && exactsums) {
+			computeGeneDuplicationsSweep(rooted, unrooted, subtree, sibling, reroot);
+			return;
+		}
+
 		// process all rooted trees
+		for(int i=0; i<rooted.size(); i++) {
+			computeGeneDuplicationsTree(*rooted[i], subtree, sibling);
+		}
+
+		// process all unrooted trees
+		for(int i=0; i<unrooted.size(); i++) {
+			computeGeneDuplicationsTree(*unrooted[i], subtree, sibling, reroot);
+		}
+	}
+
+	// add the gene duplications and losses of one rooted gene tree to the scores of the species nodes
+	// (subtreeset has to hold the species of the pruned subtree)
+	inline void computeGeneDuplicationsTree(GeneTreeRooted &tree, SpeciesNode *subtree, SpeciesNode *sibling) {
+		SpeciesNode *LossSibling;
+		if (isFixedCost(tree)) {
+			updateCost(tree);
+			addGeneTreeCost(sibling, tree.cost.dup * tree.weight, tree.weight * tree.cost.loss);
+			return;
+		}
+		updatePrimaryMapping(tree);
+		const double score = getScore(tree) * tree.weight;
+		createSecondaryMapping(tree, subtree);
+		computeGeneDuplicationsTriple();
+//		removeSecondaryMapping(tree);
+		computeGeneDuplicationsAdd(sibling, score, tree.weight);
+
+			// Add stuff to handle losses
+		prepareRelevantTree(tree);
+		double initLoss  = tree.weight * computeGeneLossForRoot(tree);
+
+		addInitialLoss(sibling, initLoss);
+
+		if(speciestree->root->isRelevant == false)
+		{
+//			cout << "Am I here by any chance?" << endl;
+			// If the gene tree is fully contained in either the pruned subtree or in the other subtree then there is nothing to be done
+		}
+		else
+		{
+			computeGeneLossCounters(tree, subtree);
+			
+			if(speciestree->root->child(0) == subtree)
+				LossSibling = speciestree->root->LossChild2;
+			else LossSibling = speciestree->root->LossChild1;
+			computeLossScores(LossSibling, tree.weight);				
+		}
+		
+		
+		removeSecondaryMapping(tree);
+	}
+
+	// add the gene duplications and losses of one unrooted gene tree to the scores of the species nodes
+	inline void computeGeneDuplicationsTree(GeneTreeUnrooted &tree, SpeciesNode *subtree, SpeciesNode *sibling, bool reroot) {
+		SpeciesNode *LossSibling;
+		if (isFixedCost(tree)) {
+			updateCost(tree, reroot);
+			if (reroot) addGeneTreeCost(sibling, tree.cost.bestdup * tree.weight, tree.weight * tree.cost.bestloss);
+			else addGeneTreeCost(sibling, tree.cost.dup * tree.weight, tree.weight * tree.cost.loss);
+			return;
+		}
+		if (reroot) { // find the best geneduplication score of all rootings (rerooting of the genetrees)
+			updatePrimaryMappingUnrooted(tree);
+			double &score = best_score;
+			score = getScore(tree) * tree.weight;
+			createSecondaryMapping(tree, subtree);
+			computeGeneDuplicationsTriple();
+//			removeSecondaryMapping(tree);
+			computeGeneDuplicationsTempReplace(sibling, score, tree.weight);
+			
+			
+			
+			
+			prepareRelevantTree(tree);
+			double initLoss  = tree.weight * computeGeneLossForRoot(tree);
+
+			copyInitialLossScoreToAllNodes_Temp(sibling, initLoss);
 
-//cout << "next iteration....................." << endl;
-		for(int i=0; i<genetree_rooted.size(); i++) {
-			GeneTreeRooted &tree = *genetree_rooted[i];
-			createPrimaryMapping(tree);
+			if(speciestree->root->isRelevant == false)
+			{
+				// If the gene tree is fully contained in either the pruned subtree or in the other subtree then there is nothing to be done
+			}
+			else
+			{
+				computeGeneLossCounters(tree, subtree);
+		
+				if(speciestree->root->child(0) == subtree)
+					LossSibling = speciestree->root->LossChild2;
+				else LossSibling = speciestree->root->LossChild1;
+				computeLossScores_Temp(LossSibling, tree.weight);				
+			}
+			removeSecondaryMapping(tree);
+			
+			
+			
+			
+			GeneNodeUnrooted *u = tree.root->child(0);
+			GeneNodeUnrooted *v = tree.root->child(1);
+			best_node[0] = u;
+			best_node[1] = v;
+			#ifdef DEBUG
+			position_counter_debug = 2;
+			if ((u == NULL) || (v == NULL)) EXCEPTION("child = NULL in computeGeneDuplications" << endl);
+			#endif
+			Rootings<GeneTreeUnrooted, SpeciesNode>::reset(tree);
+			moveRoot(tree, u, subtree, sibling);
+			moveRoot(tree, v, subtree, sibling);
+			#ifdef DEBUG
+			if (position_counter_debug != tree.nodes.size()-1)
+				WARNING("tree traversal failed in computeGeneDuplications" << position_counter_debug << " != " << tree.nodes.size()-1 << endl);
+			#endif
+			tree.reroot(u, v);
+			addTempGeneDuplications(sibling);
+		} 
+		else 
+		{ // find the best genedupication of the current rooting
+			updatePrimaryMapping(tree);
 			const double score = getScore(tree) * tree.weight;
 			createSecondaryMapping(tree, subtree);
 			computeGeneDuplicationsTriple();
 //			removeSecondaryMapping(tree);
 			computeGeneDuplicationsAdd(sibling, score, tree.weight);
-
+			
 				// Add stuff to handle losses
-			resetRelevantTree(speciestree->root);
-			buildRelevantTree(tree);
+			prepareRelevantTree(tree);
 			double initLoss  = tree.weight * computeGeneLossForRoot(tree);
 
-			copyInitialLossScoreToAllNodes(sibling, initLoss);
+			addInitialLoss(sibling, initLoss);
 
 			if(speciestree->root->isRelevant == false)
 			{
-//				cout << "Am I here by any chance?" << endl;
 				// If the gene tree is fully contained in either the pruned subtree or in the other subtree then there is nothing to be done
 			}
 			else
 			{
 				computeGeneLossCounters(tree, subtree);
-				
+		
 				if(speciestree->root->child(0) == subtree)
 					LossSibling = speciestree->root->LossChild2;
 				else LossSibling = speciestree->root->LossChild1;
 				computeLossScores(LossSibling, tree.weight);				
 			}
-			
-			
 			removeSecondaryMapping(tree);
 			
 		}
+	}
 
 
+	// ------------------------------------------------------------------------------------------------------
+	// sweep engine: instead of walking the species tree a few times for every gene tree, the gene trees of a
+	// prune candidate add their triples and loss counters into the same species nodes and the species tree is
+	// walked once for all trees of the same weight; with unlimited losses the relevant tree of every gene tree
+	// is the whole species tree and it is built once per candidate
+	// (unrooted trees that are rerooted take the minimum of their rootings at every node and keep their walks)
+	// the shared walks add up the scores in another order, which is only exact for integer weights; with other
+	// weights every gene tree keeps its own walks in input order, so both engines give the same scores
+	Engine engine;
+	vector<pair<double, int> > sweeporder; // (weight, gene tree) of the trees sharing the walks, rooted trees first
+
+	void setEngine(const Engine e) {
+		engine = e;
+	}
 
-		// process all unrooted trees
-		for(int i=0; i<genetree_unrooted.size(); i++) {
-			GeneTreeUnrooted &tree = *genetree_unrooted[i];
-			if (reroot) { // find the best geneduplication score of all rootings (rerooting of the genetrees)
-				createPrimaryMappingUnrooted(tree);
-				double &score = best_score;
-				score = getScore(tree) * tree.weight;
-				createSecondaryMapping(tree, subtree);
-				computeGeneDuplicationsTriple();
-//				removeSecondaryMapping(tree);
-				computeGeneDuplicationsTempReplace(sibling, score, tree.weight);
-				
-				
-				
-				
-				resetRelevantTree(speciestree->root);
-				buildRelevantTree(tree);
-				double initLoss  = tree.weight * computeGeneLossForRoot(tree);
-
-				copyInitialLossScoreToAllNodes_Temp(sibling, initLoss);
-
-				if(speciestree->root->isRelevant == false)
-				{
-					// If the gene tree is fully contained in either the pruned subtree or in the other subtree then there is nothing to be done
-				}
-				else
-				{
-					computeGeneLossCounters(tree, subtree);
-			
-					if(speciestree->root->child(0) == subtree)
-						LossSibling = speciestree->root->LossChild2;
-					else LossSibling = speciestree->root->LossChild1;
-					computeLossScores_Temp(LossSibling, tree.weight);				
-				}
-				removeSecondaryMapping(tree);
-				
-				
-				
-				
-				GeneNodeUnrooted *u = tree.root->child(0);
-				GeneNodeUnrooted *v = tree.root->child(1);
-				best_node[0] = u;
-				best_node[1] = v;
-				#ifdef DEBUG
-				position_counter_debug = 2;
-				if ((u == NULL) || (v == NULL)) EXCEPTION("child = NULL in computeGeneDuplications" << endl);
-				#endif
-				moveRoot(tree, u, subtree, sibling);
-				moveRoot(tree, v, subtree, sibling);
-				#ifdef DEBUG
-				if (position_counter_debug != tree.nodes.size()-1)
-					WARNING("tree traversal failed in computeGeneDuplications" << position_counter_debug << " != " << tree.nodes.size()-1 << endl);
-				#endif
-				tree.reroot(u, v);
-				addTempGeneDuplications(sibling);
-			} 
-			else 
-			{ // find the best genedupication of the current rooting
-				createPrimaryMapping(tree);
-				const double score = getScore(tree) * tree.weight;
-				createSecondaryMapping(tree, subtree);
-				computeGeneDuplicationsTriple();
-//				removeSecondaryMapping(tree);
-				computeGeneDuplicationsAdd(sibling, score, tree.weight);
-				
-					// Add stuff to handle losses
-				resetRelevantTree(speciestree->root);
-				buildRelevantTree(tree);
-				double initLoss  = tree.weight * computeGeneLossForRoot(tree);
-
-				copyInitialLossScoreToAllNodes(sibling, initLoss);
+	void computeGeneDuplicationsSweep(vector<GeneTreeRooted*> &rooted, vector<GeneTreeUnrooted*> &unrooted, SpeciesNode *subtree, SpeciesNode *sibling, const bool reroot) {
+		const int numrooted = rooted.size();
+		double dupconst = 0, lossconst = 0; // cost added to all regraft positions
+		sweeporder.clear();
+		for (int i=0; i<numrooted; i++) {
+			GeneTreeRooted &tree = *rooted[i];
+			if (isFixedCost(tree)) {
+				updateCost(tree);
+				dupconst += tree.cost.dup * tree.weight;
+				lossconst += tree.weight * tree.cost.loss;
+			} else sweeporder.push_back(pair<double, int>(tree.weight, i));
+		}
+		for (int i=0; i<unrooted.size(); i++) {
+			GeneTreeUnrooted &tree = *unrooted[i];
+			if (isFixedCost(tree)) {
+				updateCost(tree, reroot);
+				dupconst += (reroot ? tree.cost.bestdup : tree.cost.dup) * tree.weight;
+				lossconst += tree.weight * (reroot ? tree.cost.bestloss : tree.cost.loss);
+			} else
+			if (reroot) computeGeneDuplicationsTree(tree, subtree, sibling, reroot);
+			else sweeporder.push_back(pair<double, int>(tree.weight, numrooted + i));
+		}
+		sort(sweeporder.begin(), sweeporder.end());
+
+		if (!LIMIT_LOSSES && !sweeporder.empty()) prepareFullRelevantTree();
+		for (int b=0, e=0, last=sweeporder.size(); b<last; b=e) {
+			const double weight = sweeporder[b].first;
+			while ((e < last) && (sweeporder[e].first == weight)) e++;
+			speciestree->resetGeneDubTriple();
+			if (!LIMIT_LOSSES && (b > 0)) resetLossCounters();
+			int dup = 0, loss = 0;
+			for (int k=b; k<e; k++) {
+				const int t = sweeporder[k].second;
+				if (t < numrooted) sweepGeneTree(*rooted[t], subtree, weight, dup, loss);
+				else sweepGeneTree(*unrooted[t - numrooted], subtree, weight, dup, loss);
+			}
+			computeGeneDuplicationsAdd(sibling, dup * weight, weight);
+			lossconst += loss * weight;
+			if (!LIMIT_LOSSES) {
+				SpeciesNode *LossSibling = speciestree->root->child(0) == subtree ? speciestree->root->LossChild2 : speciestree->root->LossChild1;
+				computeLossScores(LossSibling, weight);
+			}
+		}
+		if (LIMIT_LOSSES) addLossMarks(sibling, 0);
+		addGeneTreeCost(sibling, dupconst, lossconst);
+	}
 
-				if(speciestree->root->isRelevant == false)
-				{
-					// If the gene tree is fully contained in either the pruned subtree or in the other subtree then there is nothing to be done
-				}
-				else
-				{
-					computeGeneLossCounters(tree, subtree);
-			
-					if(speciestree->root->child(0) == subtree)
-						LossSibling = speciestree->root->LossChild2;
-					else LossSibling = speciestree->root->LossChild1;
-					computeLossScores(LossSibling, tree.weight);				
-				}
-				removeSecondaryMapping(tree);
-				
+	// with limited losses the loss score differences of a gene tree are kept as marks at the top of the edges of
+	// its relevant tree (the species node below the relevant parent, the whole subtree takes the change) and
+	// one walk adds them up for all gene trees, so a gene tree only visits its relevant tree
+	void markLossScores(SpeciesNode *node, const double weight) {
+		for (int i=0, last=relevantnodes.size(); i<last; i++) {
+			SpeciesNode *r = relevantnodes[i].second;
+			if (!speciestree->isAncestor(node, r)) continue;
+			if (r == node) {
+				getRootChildAbove(r)->lossMark += weight * r->LossScoreDiff;
+				continue;
 			}
+			SpeciesNode *p = r->LossParent;
+			SpeciesNode *top = speciestree->isAncestor(p->child(0), r) ? p->child(0) : p->child(1);
+			top->lossMark += weight * (r->LossScoreDiff - p->LossScoreDiff);
 		}
-		speciestree->postprocessLCA();
-		
-		// 1 line of code to assign loss scores for non-relevant nodes.
-//		AssignLossScoresToNonRelevantNodes(sibling);		
+	}
+	void addLossMarks(SpeciesNode *node, double score) {
+		score += node->lossMark;
+		node->lossMark = 0;
+		node->lossScore = node->lossScore + score;
+		for (int i=0; i<2; i++) {
+			if (node->child(i) != NULL) addLossMarks(node->child(i), score);
+		}
+	}
 
-/*		// extra 1 line of code for losses
-//		AddLossCounterToDupScoreCounter(sibling);
-*/		
-//		outputSpeciesTreeNodes(speciestree->root);	
-//		cout << endl<< endl;
-		forEachCallScoreComputed(subtree, sibling);
-		
+	// add the triples and loss counters of one gene tree and its cost at the root to dup and loss
+	// (with limited losses the gene tree has its own relevant tree and its loss scores are added right away)
+	template<class GeneTree>
+	void sweepGeneTree(GeneTree &tree, SpeciesNode *subtree, const double weight, int &dup, int &loss) {
+		updatePrimaryMapping(tree);
+		dup += getScore(tree);
+		createSecondaryMapping(tree, subtree);
+		computeGeneDuplicationsTripleAdd();
+		if (LIMIT_LOSSES) prepareRelevantTree(tree);
+		loss += computeGeneLossForRoot(tree);
+		if (speciestree->root->isRelevant) {
+			computeGeneLossCounters(tree, subtree);
+			if (LIMIT_LOSSES) {
+				SpeciesNode *LossSibling = speciestree->root->child(0) == subtree ? speciestree->root->LossChild2 : speciestree->root->LossChild1;
+				computeLossScoreDiffs(LossSibling);
+				markLossScores(LossSibling, weight);
+			}
+		}
+		removeSecondaryMapping(tree);
 	}
 
+	// relevant tree of a gene tree: with unlimited losses every species node is relevant, so the links and
+	// depths only depend on the species tree and are built once for its current shape; a gene tree that
+	// reuses them only needs cleared loss counters
+	template<class GeneTree>
+	inline void prepareRelevantTree(GeneTree &tree) {
+		if (LIMIT_LOSSES) {
+			speciestree->resetRelevantTree();
+			buildRelevantTree(tree);
+		} else prepareFullRelevantTree();
+	}
+	void prepareFullRelevantTree() {
+		if (speciestree->fullrelevant) {
+			resetLossCounters();
+			return;
+		}
+		speciestree->resetRelevantTree();
+		doPostOrder(speciestree->root);
+		doSecondPostOrder(speciestree->root);
+		doPreOrder(speciestree->root, 1);
+		setPointersPostOrder(speciestree->root);
+		speciestree->fullrelevant = true;
+	}
 
 //-------------------Losses stuff begin-------------------------------------------------------------------
 
@@ -222,85 +414,55 @@ public:
 			resetLossStuff(node->child(i));
 	}
 
-	// Reset the subtreeSize counter at each node to 0, reset the isRelevant flag to false and and set nodeDepth to 0
-	void resetRelevantTree(SpeciesNode *node){
-		if (node->child(0) != NULL) {
-			resetRelevantTree(node->child(0));
-		}
-		if (node->child(1) != NULL) {
-			resetRelevantTree(node->child(1));
-		}
-
-		node->subtreeSize = 0;
-		node->LossScoreDiff = 0;
-//		node->lossScoreTemp = 0;
-		node->isRelevant = false;
-		node->nodeDepth = 0;
-		node->lossCounter1 = 0;
-		node->lossCounter2 = 0;
-		node->lossCounter3 = 0;
-		node->lossCounter4 = 0;
-		node->lossCounter5 = 0;
-		node->lossCounter6 = 0;
-		node->LossParent = NULL;
-		node->LossChild1 = NULL;
-		node->LossChild2 = NULL;
-
-	}
-
-
-
-	// Mark the useless nodes that are not present in the species tree build on the gene tree's taxa set. 
-	void buildRelevantTree(GeneTreeRooted &tree) {
-		vector<NamedGeneNodeRooted*> &g = tree.leafnodes;
-		// process leaf mappings
-		for(vector<NamedGeneNodeRooted*>::iterator itr=g.begin(); itr!=g.end(); itr++) {
-			NamedGeneNodeRooted *genenode = *itr;
-			SpeciesNode *&mapping = genenode->getMapping();
-			mapping->subtreeSize = mapping->subtreeSize + 1;
+	// relevant tree with limited losses: the species tree induced by the leaf mappings of the gene tree (its
+	// nodes are the leaf mappings and the LCAs of neighbours in preorder), linked with a stack of its path to
+	// the current node in preorder; only the nodes of the relevant tree and the root are touched, the other
+	// species nodes keep the loss fields of an older epoch (see SpeciesTree::inRelevantTree)
+	vector<pair<uint64_t, SpeciesNode*> > relevantnodes;
+	vector<SpeciesNode*> relevantstack;
+	template<class GeneTree>
+	void buildRelevantTree(GeneTree &tree) {
+		const unsigned int epoch = speciestree->relevantepoch;
+		speciestree->root->touchRelevant(epoch);
+		relevantnodes.clear();
+		for (int i=0, last=tree.leafnodes.size(); i<last; i++) {
+			SpeciesNode *mapping = tree.leafnodes[i]->getMapping();
+			mapping->touchRelevant(epoch);
+			if (mapping->subtreeSize++ > 0) continue;
+			mapping->isRelevant = true;
+			relevantnodes.push_back(make_pair(speciestree->getPreorderKey(mapping), mapping));
+		}
+		sort(relevantnodes.begin(), relevantnodes.end());
+		for (int i=1, last=relevantnodes.size(); i<last; i++) {
+			SpeciesNode *node = speciestree->getLCA(relevantnodes[i-1].second, relevantnodes[i].second);
+			node->touchRelevant(epoch);
+			if (node->isRelevant) continue;
+			node->isRelevant = true;
+			relevantnodes.push_back(make_pair(speciestree->getPreorderKey(node), node));
+		}
+		sort(relevantnodes.begin(), relevantnodes.end());
+
+		// set the LossParent, LossChild1 and LossChild2 pointers and the depths (1 for the root of the relevant tree)
+		relevantstack.clear();
+		for (int i=0, last=relevantnodes.size(); i<last; i++) {
+			SpeciesNode *node = relevantnodes[i].second;
+			while (!relevantstack.empty() && !speciestree->isAncestor(relevantstack.back(), node)) relevantstack.pop_back();
+			if (relevantstack.empty()) node->nodeDepth = 1;
+			else {
+				SpeciesNode *parent = relevantstack.back();
+				if (parent->LossChild1 == NULL) parent->LossChild1 = node;
+				else parent->LossChild2 = node;
+				node->LossParent = parent;
+				node->nodeDepth = parent->nodeDepth + 1;
+			}
+			relevantstack.push_back(node);
 		}
-
-		// perform post order traversal, to compute the value of subtreeSize at each species node.
-		doPostOrder(speciestree->root);
-
-		// Set the isRelevant flag for each node 
-		doSecondPostOrder(speciestree->root);
-		
-		// set the nodeDepth flag to the correct value
-		doPreOrder(speciestree->root, 1);
-
-		// Set the LossParent, LossChild[0], and LossChild[1] pointers
-		setPointersPostOrder(speciestree->root);
-
 	}
-   
-	
-	void buildRelevantTree(GeneTreeUnrooted &tree) {
-		vector<NamedGeneNodeUnrooted*> &g = tree.leafnodes;
-		// process leaf mappings
-		for(vector<NamedGeneNodeUnrooted*>::iterator itr=g.begin(); itr!=g.end(); itr++) {
-			NamedGeneNodeUnrooted *genenode = *itr;
-			SpeciesNode *&mapping = genenode->getMapping();
-			mapping->subtreeSize = mapping->subtreeSize + 1;
-		}
-
-		// perform post order traversal, to compute the value of subtreeSize at each species node.
-		doPostOrder(speciestree->root);
-
-		// Set the isRelevant flag for each node 
-		doSecondPostOrder(speciestree->root);
-		
-		// set the nodeDepth flag to the correct value
-		doPreOrder(speciestree->root, 1);
-
-		// Set the LossParent, LossChild[0], and LossChild[1] pointers
-		setPointersPostOrder(speciestree->root);
 
-	}	
-	
-	
 	// builds the subtreeSize counter by doing a post order traversal of the species tree 
+	// (it visits every node first, so the loss fields of an older relevant tree are cleared here)
 	void doPostOrder(SpeciesNode *node) {
+		node->touchRelevant(speciestree->relevantepoch);
 		if (node->child(0) != NULL) {
 			doPostOrder(node->child(0));
 		}
@@ -472,10 +634,20 @@ public:
 	}
 	
 
+	// add the loss score of a gene tree at the root to all regraft positions
+	// (a scoring worker with non-integer weights keeps it apart, see HeuristicWorker::scoreTrees)
+	inline void addInitialLoss(SpeciesNode *&node, const double initLoss) {
+		if (keepinitloss) {
+			initloss = initLoss;
+			return;
+		}
+		copyInitialLossScoreToAllNodes(node, initLoss);
+	}
+
 	// Add the loss score computed at the root throughout the tree, to add and subtract to these values later.
 	void copyInitialLossScoreToAllNodes(SpeciesNode *&node, double initLoss)
 	{
-		if (node == NULL) return;
+		if ((node == NULL) || outsideRegraftRegion(node)) return;
 		node->lossScore = node->lossScore + initLoss;
 		for (int i=0; i<2; i++)
 			copyInitialLossScoreToAllNodes(node->child(i), initLoss);
@@ -503,19 +675,9 @@ public:
 				if(mapping != speciestree->root)
 				{
 					
-					temp_mapping = genenode->child(0)->getMapping();
-					while(temp_mapping != mapping)
-					{
-						temp_mapping->lossCounter1 = temp_mapping->lossCounter1 + 1;
-						temp_mapping = temp_mapping->LossParent;
-					}
+					addPathCounter1(genenode->child(0)->getMapping(), mapping);
 					
-					temp_mapping = genenode->child(1)->getMapping();
-					while(temp_mapping != mapping)
-					{
-						temp_mapping->lossCounter1 = temp_mapping->lossCounter1 + 1;
-						temp_mapping = temp_mapping->LossParent;
-					}
+					addPathCounter1(genenode->child(1)->getMapping(), mapping);
 				}
 
 				// Case 2: g, g' and g'' all map to the root
@@ -527,50 +689,22 @@ public:
 					
 					if((secmapping!= leftchild_secmapping) && (secmapping!= rightchild_secmapping))
 					{
-						temp_mapping = genenode->child(0)->secondarymapping;
-						while(temp_mapping != secmapping)
-						{
-							temp_mapping->lossCounter2 = temp_mapping->lossCounter2 + 1;
-//							if(temp_mapping->parent() == secmapping)
-//								temp_mapping->lossCounter2 = temp_mapping->lossCounter2 + 1;
-							temp_mapping = temp_mapping->LossParent;
-						}
+						addPathCounter2(genenode->child(0)->secondarymapping, secmapping);
 			
-						temp_mapping = genenode->child(1)->secondarymapping;
-						while(temp_mapping != secmapping)
-						{
-							temp_mapping->lossCounter2 = temp_mapping->lossCounter2 + 1;
-//							if(temp_mapping->parent() == secmapping)
-//								temp_mapping->lossCounter2 = temp_mapping->lossCounter2 + 1;
-							temp_mapping = temp_mapping->LossParent;
-						}
+						addPathCounter2(genenode->child(1)->secondarymapping, secmapping);
 					}
 					
 					else if((secmapping == leftchild_secmapping) && (secmapping!= rightchild_secmapping))
 					{
 						
-						temp_mapping = genenode->child(1)->secondarymapping;
-						while(temp_mapping != secmapping)
-						{
-							temp_mapping->lossCounter2 = temp_mapping->lossCounter2 + 1;
-//							if(temp_mapping->parent() == secmapping)
-//								temp_mapping->lossCounter2 = temp_mapping->lossCounter2 + 1;
-							temp_mapping = temp_mapping->LossParent;
-						}
+						addPathCounter2(genenode->child(1)->secondarymapping, secmapping);
 					}
 					
 					
 					else if((secmapping != leftchild_secmapping) && (secmapping == rightchild_secmapping))
 					{
 						
-						temp_mapping = genenode->child(0)->secondarymapping;
-						while(temp_mapping != secmapping)
-						{
-							temp_mapping->lossCounter2 = temp_mapping->lossCounter2 + 1;
-//							if(temp_mapping->parent() == secmapping)
-//								temp_mapping->lossCounter2 = temp_mapping->lossCounter2 + 1;
-							temp_mapping = temp_mapping->LossParent;
-						}
+						addPathCounter2(genenode->child(0)->secondarymapping, secmapping);
 					}
 					
 				}
@@ -585,81 +719,37 @@ public:
 
 					if((secmapping!= leftchild_secmapping) && (secmapping!= rightchild_secmapping))
 					{
-						temp_mapping = genenode->secondarymapping;
-						while(temp_mapping->LossParent != speciestree->root)
-						{
-							temp_mapping->lossCounter6 = temp_mapping->lossCounter6 + 1;
-							//SpeciesNode *sib = temp_mapping->getSibling();
-							temp_mapping->getLossSibling()->lossCounter6 = temp_mapping->getLossSibling()->lossCounter6 + 1;
-							temp_mapping = temp_mapping->LossParent;
-						}
+						addPathCounter6(genenode->secondarymapping);
 //cout << secmapping->LossChild1 << " " << secmapping->child(0) << endl;
 //cout << secmapping->LossChild2 << " " << secmapping->child(1) << endl;
 //cout << secmapping->LossParent << " " << secmapping->parent() << endl;
     					secmapping->LossChild1->lossCounter6 = secmapping->LossChild1->lossCounter6 + 1;
 						secmapping->LossChild2->lossCounter6 = secmapping->LossChild2->lossCounter6 + 1;
-						temp_mapping = genenode->child(0)->secondarymapping;
-						while(temp_mapping->LossParent != secmapping)
-						{
-							temp_mapping->lossCounter2 = temp_mapping->lossCounter2 + 1;
-//							temp_mapping->lossCounter1 = temp_mapping->lossCounter1 + 1;
-							temp_mapping = temp_mapping->LossParent;
-						}
+						temp_mapping = getLossChildAbove(secmapping, genenode->child(0)->secondarymapping);
+						addPathCounter2(genenode->child(0)->secondarymapping, temp_mapping);
 						temp_mapping->lossCounter6 = temp_mapping->lossCounter6 + 1;
-						temp_mapping = genenode->child(1)->getMapping();
-						while(temp_mapping != secmapping)
-						{
-							temp_mapping->lossCounter1 = temp_mapping->lossCounter1 + 1;
-							temp_mapping = temp_mapping->LossParent;
-						}
+						addPathCounter1(genenode->child(1)->getMapping(), secmapping);
 					}
 					
 					else if((secmapping == leftchild_secmapping) && (secmapping != rightchild_secmapping))
 					{
 						
 					
-						temp_mapping = genenode->secondarymapping;
-						while(temp_mapping->LossParent != speciestree->root)
-						{
-							temp_mapping->lossCounter6 = temp_mapping->lossCounter6 + 1;
-							temp_mapping->getLossSibling()->lossCounter6 = temp_mapping->getLossSibling()->lossCounter6 + 1;
-
-							temp_mapping = temp_mapping->LossParent;
-							
-						}
+						addPathCounter6(genenode->secondarymapping);
 						
 						secmapping->LossChild1->lossCounter6 = secmapping->LossChild1->lossCounter6 + 1;
 						secmapping->LossChild2->lossCounter6 = secmapping->LossChild2->lossCounter6 + 1;
-						temp_mapping = genenode->child(1)->getMapping();
-						
-						while(temp_mapping != secmapping)
-						{
-							temp_mapping->lossCounter1 = temp_mapping->lossCounter1 + 1;
-							
-							temp_mapping = temp_mapping->LossParent;
-						}
+						addPathCounter1(genenode->child(1)->getMapping(), secmapping);
 					}					
 					
 					else if((secmapping != leftchild_secmapping) && (secmapping == rightchild_secmapping))
 					{
 						
-						temp_mapping = genenode->secondarymapping;
-						while(temp_mapping->LossParent != speciestree->root)
-						{
-							temp_mapping->lossCounter6 = temp_mapping->lossCounter6 + 1;
-							temp_mapping->getLossSibling()->lossCounter6 = temp_mapping->getLossSibling()->lossCounter6 + 1;
-							
-							temp_mapping = temp_mapping->LossParent;
-						}
+						addPathCounter6(genenode->secondarymapping);
 						
-						temp_mapping = genenode->child(0)->secondarymapping;
+						temp_mapping = getLossChildAbove(secmapping, genenode->child(0)->secondarymapping);
+						addPathCounter2(genenode->child(0)->secondarymapping, temp_mapping);
 						sibli = temp_mapping->getLossSibling();
-						while(temp_mapping->LossParent != secmapping)
-						{
-							temp_mapping->lossCounter2 = temp_mapping->lossCounter2 + 1;
-							temp_mapping = temp_mapping->LossParent;
-							sibli = temp_mapping->getLossSibling();
-						}
 						
 						sibli->lossCounter6 = sibli->lossCounter6 + 1;
 						
@@ -668,17 +758,7 @@ public:
 					else if((secmapping == leftchild_secmapping) && (secmapping == rightchild_secmapping))
 					{
 						
-						temp_mapping = genenode->secondarymapping;
-						
-						while(temp_mapping->LossParent != speciestree->root)
-						{
-							
-							temp_mapping->lossCounter6 = temp_mapping->lossCounter6 + 1;
-							temp_mapping->getLossSibling()->lossCounter6 = temp_mapping->getLossSibling()->lossCounter6 + 1;
-							
-							temp_mapping = temp_mapping->LossParent;
-							
-						}
+						addPathCounter6(genenode->secondarymapping);
 					
 						
 						if(genenode->secondarymapping->LossChild1 != NULL)
@@ -699,77 +779,34 @@ public:
 
 					if((secmapping!= leftchild_secmapping) && (secmapping!= rightchild_secmapping))
 					{
-						temp_mapping = genenode->secondarymapping;
-						while(temp_mapping->LossParent != speciestree->root)
-						{
-							temp_mapping->lossCounter6 = temp_mapping->lossCounter6 + 1;
-							temp_mapping->getLossSibling()->lossCounter6 = temp_mapping->getLossSibling()->lossCounter6 + 1;
-							
-							temp_mapping = temp_mapping->LossParent;
-						}
+						addPathCounter6(genenode->secondarymapping);
 						secmapping->LossChild1->lossCounter6 = secmapping->LossChild1->lossCounter6 + 1;
 						secmapping->LossChild2->lossCounter6 = secmapping->LossChild2->lossCounter6 + 1;
 						
-						temp_mapping = genenode->child(1)->secondarymapping;
-						while(temp_mapping->LossParent != secmapping)
-						{
-							temp_mapping->lossCounter2 = temp_mapping->lossCounter2 + 1;
-//							temp_mapping->lossCounter1 = temp_mapping->lossCounter1 + 1;
-							temp_mapping = temp_mapping->LossParent;
-						}
+						temp_mapping = getLossChildAbove(secmapping, genenode->child(1)->secondarymapping);
+						addPathCounter2(genenode->child(1)->secondarymapping, temp_mapping);
 						temp_mapping->lossCounter6 = temp_mapping->lossCounter6 + 1;
 
-						temp_mapping = genenode->child(0)->getMapping();
-						while(temp_mapping != secmapping)
-						{
-							temp_mapping->lossCounter1 = temp_mapping->lossCounter1 + 1;
-							temp_mapping = temp_mapping->LossParent;
-						}
+						addPathCounter1(genenode->child(0)->getMapping(), secmapping);
 						
 					}
 					
 					else if((secmapping != leftchild_secmapping) && (secmapping == rightchild_secmapping))
 					{
-						temp_mapping = genenode->secondarymapping;
-						while(temp_mapping->LossParent != speciestree->root)
-						{
-							temp_mapping->lossCounter6 = temp_mapping->lossCounter6 + 1;
-							temp_mapping->getLossSibling()->lossCounter6 = temp_mapping->getLossSibling()->lossCounter6 + 1;
-							
-							temp_mapping = temp_mapping->LossParent;
-						}
+						addPathCounter6(genenode->secondarymapping);
 						
 						secmapping->LossChild1->lossCounter6 = secmapping->LossChild1->lossCounter6 + 1;
 						secmapping->LossChild2->lossCounter6 = secmapping->LossChild2->lossCounter6 + 1;
-						temp_mapping = genenode->child(0)->getMapping();
-						while(temp_mapping != secmapping)
-						{
-							temp_mapping->lossCounter1 = temp_mapping->lossCounter1 + 1;
-							temp_mapping = temp_mapping->LossParent;
-						}
+						addPathCounter1(genenode->child(0)->getMapping(), secmapping);
 					}					
 
 					else if((secmapping == leftchild_secmapping) && (secmapping != rightchild_secmapping))
 					{
-						temp_mapping = genenode->secondarymapping;
-						while(temp_mapping->LossParent != speciestree->root)
-						{
-							temp_mapping->lossCounter6 = temp_mapping->lossCounter6 + 1;
-							temp_mapping->getLossSibling()->lossCounter6 = temp_mapping->getLossSibling()->lossCounter6 + 1;
-							
-							temp_mapping = temp_mapping->LossParent;
-						}
+						addPathCounter6(genenode->secondarymapping);
 						
-						temp_mapping = genenode->child(1)->secondarymapping;
+						temp_mapping = getLossChildAbove(secmapping, genenode->child(1)->secondarymapping);
+						addPathCounter2(genenode->child(1)->secondarymapping, temp_mapping);
 						sibli = temp_mapping->getLossSibling();
-						while(temp_mapping->LossParent != secmapping)
-						{
-							temp_mapping->lossCounter2 = temp_mapping->lossCounter2 + 1;
-							
-							temp_mapping = temp_mapping->LossParent;
-							sibli = temp_mapping->getLossSibling();
-							
-						}
 						
 						sibli->lossCounter6 = sibli->lossCounter6 + 1;
 						
@@ -777,14 +814,7 @@ public:
 					
 					else if((secmapping== leftchild_secmapping) && (secmapping == rightchild_secmapping))
 					{
-						temp_mapping = genenode->secondarymapping;
-						while(temp_mapping->LossParent != speciestree->root)
-						{
-							temp_mapping->lossCounter6 = temp_mapping->lossCounter6 + 1;
-							temp_mapping->getLossSibling()->lossCounter6 = temp_mapping->getLossSibling()->lossCounter6 + 1;
-							
-							temp_mapping = temp_mapping->LossParent;
-						}
+						addPathCounter6(genenode->secondarymapping);
 						
 						if(genenode->secondarymapping->LossChild1 != NULL)
 						{
@@ -933,19 +963,9 @@ public:
 				if(mapping != speciestree->root)
 				{
 					
-					temp_mapping = genenode->child(0)->getMapping();
-					while(temp_mapping != mapping)
-					{
-						temp_mapping->lossCounter1 = temp_mapping->lossCounter1 + 1;
-						temp_mapping = temp_mapping->LossParent;
-					}
+					addPathCounter1(genenode->child(0)->getMapping(), mapping);
 					
-					temp_mapping = genenode->child(1)->getMapping();
-					while(temp_mapping != mapping)
-					{
-						temp_mapping->lossCounter1 = temp_mapping->lossCounter1 + 1;
-						temp_mapping = temp_mapping->LossParent;
-					}
+					addPathCounter1(genenode->child(1)->getMapping(), mapping);
 				}
 
 				// Case 2: g, g' and g'' all map to the root
@@ -957,50 +977,22 @@ public:
 					
 					if((secmapping!= leftchild_secmapping) && (secmapping!= rightchild_secmapping))
 					{
-						temp_mapping = genenode->child(0)->secondarymapping;
-						while(temp_mapping != secmapping)
-						{
-							temp_mapping->lossCounter2 = temp_mapping->lossCounter2 + 1;
-//							if(temp_mapping->parent() == secmapping)
-//								temp_mapping->lossCounter2 = temp_mapping->lossCounter2 + 1;
-							temp_mapping = temp_mapping->LossParent;
-						}
+						addPathCounter2(genenode->child(0)->secondarymapping, secmapping);
 			
-						temp_mapping = genenode->child(1)->secondarymapping;
-						while(temp_mapping != secmapping)
-						{
-							temp_mapping->lossCounter2 = temp_mapping->lossCounter2 + 1;
-//							if(temp_mapping->parent() == secmapping)
-//								temp_mapping->lossCounter2 = temp_mapping->lossCounter2 + 1;
-							temp_mapping = temp_mapping->LossParent;
-						}
+						addPathCounter2(genenode->child(1)->secondarymapping, secmapping);
 					}
 					
 					else if((secmapping == leftchild_secmapping) && (secmapping!= rightchild_secmapping))
 					{
 						
-						temp_mapping = genenode->child(1)->secondarymapping;
-						while(temp_mapping != secmapping)
-						{
-							temp_mapping->lossCounter2 = temp_mapping->lossCounter2 + 1;
-//							if(temp_mapping->parent() == secmapping)
-//								temp_mapping->lossCounter2 = temp_mapping->lossCounter2 + 1;
-							temp_mapping = temp_mapping->LossParent;
-						}
+						addPathCounter2(genenode->child(1)->secondarymapping, secmapping);
 					}
 					
 					
 					else if((secmapping != leftchild_secmapping) && (secmapping == rightchild_secmapping))
 					{
 						
-						temp_mapping = genenode->child(0)->secondarymapping;
-						while(temp_mapping != secmapping)
-						{
-							temp_mapping->lossCounter2 = temp_mapping->lossCounter2 + 1;
-//							if(temp_mapping->parent() == secmapping)
-//								temp_mapping->lossCounter2 = temp_mapping->lossCounter2 + 1;
-							temp_mapping = temp_mapping->LossParent;
-						}
+						addPathCounter2(genenode->child(0)->secondarymapping, secmapping);
 					}
 					
 				}
@@ -1015,78 +1007,34 @@ public:
 
 					if((secmapping!= leftchild_secmapping) && (secmapping!= rightchild_secmapping))
 					{
-						temp_mapping = genenode->secondarymapping;
-						while(temp_mapping->LossParent != speciestree->root)
-						{
-							temp_mapping->lossCounter6 = temp_mapping->lossCounter6 + 1;
-							//SpeciesNode *sib = temp_mapping->getSibling();
-							temp_mapping->getLossSibling()->lossCounter6 = temp_mapping->getLossSibling()->lossCounter6 + 1;
-							temp_mapping = temp_mapping->LossParent;
-						}
+						addPathCounter6(genenode->secondarymapping);
     					secmapping->LossChild1->lossCounter6 = secmapping->LossChild1->lossCounter6 + 1;
 						secmapping->LossChild2->lossCounter6 = secmapping->LossChild2->lossCounter6 + 1;
-						temp_mapping = genenode->child(0)->secondarymapping;
-						while(temp_mapping->LossParent != secmapping)
-						{
-							temp_mapping->lossCounter2 = temp_mapping->lossCounter2 + 1;
-//							temp_mapping->lossCounter1 = temp_mapping->lossCounter1 + 1;
-							temp_mapping = temp_mapping->LossParent;
-						}
+						temp_mapping = getLossChildAbove(secmapping, genenode->child(0)->secondarymapping);
+						addPathCounter2(genenode->child(0)->secondarymapping, temp_mapping);
 						temp_mapping->lossCounter6 = temp_mapping->lossCounter6 + 1;
-						temp_mapping = genenode->child(1)->getMapping();
-						while(temp_mapping != secmapping)
-						{
-							temp_mapping->lossCounter1 = temp_mapping->lossCounter1 + 1;
-							temp_mapping = temp_mapping->LossParent;
-						}
+						addPathCounter1(genenode->child(1)->getMapping(), secmapping);
 					}
 					
 					else if((secmapping == leftchild_secmapping) && (secmapping != rightchild_secmapping))
 					{
 						
 					
-						temp_mapping = genenode->secondarymapping;
-						while(temp_mapping->LossParent != speciestree->root)
-						{
-							temp_mapping->lossCounter6 = temp_mapping->lossCounter6 + 1;
-							temp_mapping->getLossSibling()->lossCounter6 = temp_mapping->getLossSibling()->lossCounter6 + 1;
-
-							temp_mapping = temp_mapping->LossParent;
-							
-						}
+						addPathCounter6(genenode->secondarymapping);
 						
 						secmapping->LossChild1->lossCounter6 = secmapping->LossChild1->lossCounter6 + 1;
 						secmapping->LossChild2->lossCounter6 = secmapping->LossChild2->lossCounter6 + 1;
-						temp_mapping = genenode->child(1)->getMapping();
-						
-						while(temp_mapping != secmapping)
-						{
-							temp_mapping->lossCounter1 = temp_mapping->lossCounter1 + 1;
-							
-							temp_mapping = temp_mapping->LossParent;
-						}
+						addPathCounter1(genenode->child(1)->getMapping(), secmapping);
 					}					
 					
 					else if((secmapping != leftchild_secmapping) && (secmapping == rightchild_secmapping))
 					{
 						
-						temp_mapping = genenode->secondarymapping;
-						while(temp_mapping->LossParent != speciestree->root)
-						{
-							temp_mapping->lossCounter6 = temp_mapping->lossCounter6 + 1;
-							temp_mapping->getLossSibling()->lossCounter6 = temp_mapping->getLossSibling()->lossCounter6 + 1;
-							
-							temp_mapping = temp_mapping->LossParent;
-						}
+						addPathCounter6(genenode->secondarymapping);
 						
-						temp_mapping = genenode->child(0)->secondarymapping;
+						temp_mapping = getLossChildAbove(secmapping, genenode->child(0)->secondarymapping);
+						addPathCounter2(genenode->child(0)->secondarymapping, temp_mapping);
 						sibli = temp_mapping->getLossSibling();
-						while(temp_mapping->LossParent != secmapping)
-						{
-							temp_mapping->lossCounter2 = temp_mapping->lossCounter2 + 1;
-							temp_mapping = temp_mapping->LossParent;
-							sibli = temp_mapping->getLossSibling();
-						}
 						
 						sibli->lossCounter6 = sibli->lossCounter6 + 1;
 						
@@ -1095,17 +1043,7 @@ public:
 					else if((secmapping == leftchild_secmapping) && (secmapping == rightchild_secmapping))
 					{
 						
-						temp_mapping = genenode->secondarymapping;
-						
-						while(temp_mapping->LossParent != speciestree->root)
-						{
-							
-							temp_mapping->lossCounter6 = temp_mapping->lossCounter6 + 1;
-							temp_mapping->getLossSibling()->lossCounter6 = temp_mapping->getLossSibling()->lossCounter6 + 1;
-							
-							temp_mapping = temp_mapping->LossParent;
-							
-						}
+						addPathCounter6(genenode->secondarymapping);
 					
 						
 						if(genenode->secondarymapping->LossChild1 != NULL)
@@ -1126,77 +1064,34 @@ public:
 
 					if((secmapping!= leftchild_secmapping) && (secmapping!= rightchild_secmapping))
 					{
-						temp_mapping = genenode->secondarymapping;
-						while(temp_mapping->LossParent != speciestree->root)
-						{
-							temp_mapping->lossCounter6 = temp_mapping->lossCounter6 + 1;
-							temp_mapping->getLossSibling()->lossCounter6 = temp_mapping->getLossSibling()->lossCounter6 + 1;
-							
-							temp_mapping = temp_mapping->LossParent;
-						}
+						addPathCounter6(genenode->secondarymapping);
 						secmapping->LossChild1->lossCounter6 = secmapping->LossChild1->lossCounter6 + 1;
 						secmapping->LossChild2->lossCounter6 = secmapping->LossChild2->lossCounter6 + 1;
 						
-						temp_mapping = genenode->child(1)->secondarymapping;
-						while(temp_mapping->LossParent != secmapping)
-						{
-							temp_mapping->lossCounter2 = temp_mapping->lossCounter2 + 1;
-//							temp_mapping->lossCounter1 = temp_mapping->lossCounter1 + 1;
-							temp_mapping = temp_mapping->LossParent;
-						}
+						temp_mapping = getLossChildAbove(secmapping, genenode->child(1)->secondarymapping);
+						addPathCounter2(genenode->child(1)->secondarymapping, temp_mapping);
 						temp_mapping->lossCounter6 = temp_mapping->lossCounter6 + 1;
 
-						temp_mapping = genenode->child(0)->getMapping();
-						while(temp_mapping != secmapping)
-						{
-							temp_mapping->lossCounter1 = temp_mapping->lossCounter1 + 1;
-							temp_mapping = temp_mapping->LossParent;
-						}
+						addPathCounter1(genenode->child(0)->getMapping(), secmapping);
 						
 					}
 					
 					else if((secmapping != leftchild_secmapping) && (secmapping == rightchild_secmapping))
 					{
-						temp_mapping = genenode->secondarymapping;
-						while(temp_mapping->LossParent != speciestree->root)
-						{
-							temp_mapping->lossCounter6 = temp_mapping->lossCounter6 + 1;
-							temp_mapping->getLossSibling()->lossCounter6 = temp_mapping->getLossSibling()->lossCounter6 + 1;
-							
-							temp_mapping = temp_mapping->LossParent;
-						}
+						addPathCounter6(genenode->secondarymapping);
 						
 						secmapping->LossChild1->lossCounter6 = secmapping->LossChild1->lossCounter6 + 1;
 						secmapping->LossChild2->lossCounter6 = secmapping->LossChild2->lossCounter6 + 1;
-						temp_mapping = genenode->child(0)->getMapping();
-						while(temp_mapping != secmapping)
-						{
-							temp_mapping->lossCounter1 = temp_mapping->lossCounter1 + 1;
-							temp_mapping = temp_mapping->LossParent;
-						}
+						addPathCounter1(genenode->child(0)->getMapping(), secmapping);
 					}					
 
 					else if((secmapping == leftchild_secmapping) && (secmapping != rightchild_secmapping))
 					{
-						temp_mapping = genenode->secondarymapping;
-						while(temp_mapping->LossParent != speciestree->root)
-						{
-							temp_mapping->lossCounter6 = temp_mapping->lossCounter6 + 1;
-							temp_mapping->getLossSibling()->lossCounter6 = temp_mapping->getLossSibling()->lossCounter6 + 1;
-							
-							temp_mapping = temp_mapping->LossParent;
-						}
+						addPathCounter6(genenode->secondarymapping);
 						
-						temp_mapping = genenode->child(1)->secondarymapping;
+						temp_mapping = getLossChildAbove(secmapping, genenode->child(1)->secondarymapping);
+						addPathCounter2(genenode->child(1)->secondarymapping, temp_mapping);
 						sibli = temp_mapping->getLossSibling();
-						while(temp_mapping->LossParent != secmapping)
-						{
-							temp_mapping->lossCounter2 = temp_mapping->lossCounter2 + 1;
-							
-							temp_mapping = temp_mapping->LossParent;
-							sibli = temp_mapping->getLossSibling();
-							
-						}
 						
 						sibli->lossCounter6 = sibli->lossCounter6 + 1;
 						
@@ -1204,14 +1099,7 @@ public:
 					
 					else if((secmapping== leftchild_secmapping) && (secmapping == rightchild_secmapping))
 					{
-						temp_mapping = genenode->secondarymapping;
-						while(temp_mapping->LossParent != speciestree->root)
-						{
-							temp_mapping->lossCounter6 = temp_mapping->lossCounter6 + 1;
-							temp_mapping->getLossSibling()->lossCounter6 = temp_mapping->getLossSibling()->lossCounter6 + 1;
-							
-							temp_mapping = temp_mapping->LossParent;
-						}
+						addPathCounter6(genenode->secondarymapping);
 						
 						if(genenode->secondarymapping->LossChild1 != NULL)
 						{
@@ -1341,9 +1229,17 @@ public:
 	
 	
 	void computeLossScores(SpeciesNode *&node, const double &weight)
+	{
+		computeLossScoreDiffs(node);
+		// copies the loss values computed at the relevant nodes to all the other nodes of the species tree.
+		TransferLossScoretoFullTree(getRootChildAbove(node), speciestree->root, 0, weight);
+	}
+
+	// loss score differences at the nodes of the relevant tree below node
+	void computeLossScoreDiffs(SpeciesNode *&node)
 	{
 //cout << *node << endl;	
-		// convert counter 5 into counter 3 and counter 6
+		// convert counter 5 into counter 3 and counter 6 (and the path updates into counters 1, 2 and 6)
 		convertCounterFive(node);
 //cout << *node << endl;		
 		// handle counter types 2 and 6, and also 1
@@ -1357,9 +1253,6 @@ public:
 //cout << *node << endl;		
 		PreOrderCounterThreeStep2(node, 0);
 //cout << *node << endl;
-		// copies the loss values computed at the relevant nodes to all the other nodes of the species tree.
-		TransferLossScoretoFullTree(node, weight);
-		
 	}
 	
 	void PreOrderCounterFirst(SpeciesNode *&node, int c)
@@ -1443,6 +1336,52 @@ public:
 */
 	}
 	
+	// ------------------------------------------------------------------------------------------------------------------
+	// path updates of the loss counters: instead of walking up the relevant tree for every gene node, only the
+	// endpoints of a path are marked and the marks are added up in the post-order pass of convertCounterFive
+
+	// counter 1 + 1 for the nodes on the path from node 'from' up to node 'to' (without 'to')
+	inline void addPathCounter1(SpeciesNode *from, SpeciesNode *to) {
+		from->lossPath1++;
+		if (to != speciestree->root) to->lossPath1--;
+	}
+
+	// counter 2 + 1 for the nodes on the path from node 'from' up to node 'to' (without 'to')
+	inline void addPathCounter2(SpeciesNode *from, SpeciesNode *to) {
+		from->lossPath2++;
+		if (to != speciestree->root) to->lossPath2--;
+	}
+
+	// counter 6 + 1 for every node on the path from node 'from' up to the child of the root (without it)
+	// and for their siblings, i.e. for both children of every node above 'from' except the root
+	inline void addPathCounter6(SpeciesNode *from) {
+		if (from->LossParent != speciestree->root) from->LossParent->lossPath6++;
+	}
+
+	// child of a node in the relevant tree on the path to one of its descendants
+	inline SpeciesNode *getLossChildAbove(SpeciesNode *node, SpeciesNode *descendant) {
+		SpeciesNode *c = node->LossChild1;
+		return ((c->begin <= descendant->no) && (descendant->no <= c->end)) ? c : node->LossChild2;
+	}
+
+	// move the path updates below a node into its counters, after its children are done (the marks are cleared)
+	inline void convertPathCounters(SpeciesNode *node) {
+		if (node->LossChild1 != NULL) {
+			SpeciesNode *c1 = node->LossChild1;
+			SpeciesNode *c2 = node->LossChild2;
+			node->lossPath1 += c1->lossPath1 + c2->lossPath1;
+			node->lossPath2 += c1->lossPath2 + c2->lossPath2;
+			node->lossPath6 += c1->lossPath6 + c2->lossPath6;
+			c1->lossCounter6 += node->lossPath6;
+			c2->lossCounter6 += node->lossPath6;
+			c1->lossPath1 = c1->lossPath2 = c1->lossPath6 = 0;
+			c2->lossPath1 = c2->lossPath2 = c2->lossPath6 = 0;
+		}
+		node->lossCounter1 += node->lossPath1;
+		node->lossCounter2 += node->lossPath2;
+		if (node->LossParent == speciestree->root) node->lossPath1 = node->lossPath2 = node->lossPath6 = 0;
+	}
+
 		// NOTE: this function does not distinguish between relevant and non-relevant nodes... TO BE FIXED
 	void convertCounterFive(SpeciesNode *&node)
 	{
@@ -1452,6 +1391,7 @@ public:
 		if (node->LossChild2 != NULL) {
 			convertCounterFive(node->LossChild2);
 		}
+		convertPathCounters(node);
 		
 		
 		
@@ -1545,85 +1485,116 @@ public:
 	}
 
 
-	void TransferLossScoretoFullTree(SpeciesNode *&node, const double &weight)
+	// the loss score difference of every species node below a child of the root: a node of the relevant tree
+	// has its own, the nodes on the path above it and the subtrees hanging off the path take its difference
+	// (the walk carries the closest relevant ancestor, the other nodes may belong to an older relevant tree)
+	inline SpeciesNode *getRootChildAbove(SpeciesNode *node) {
+		SpeciesNode *c = speciestree->root->child(0);
+		return speciestree->isAncestor(c, node) ? c : speciestree->root->child(1);
+	}
+	inline int getLossScoreDiff(SpeciesNode *node, SpeciesNode *&relevant, const int diff) {
+		if (speciestree->inRelevantTree(node)) {
+			relevant = node;
+			return node->LossScoreDiff;
+		}
+		SpeciesNode *c = relevant->LossChild1;
+		if ((c != NULL) && speciestree->isAncestor(node, c)) return c->LossScoreDiff;
+		c = relevant->LossChild2;
+		if ((c != NULL) && speciestree->isAncestor(node, c)) return c->LossScoreDiff;
+		return diff;
+	}
+
+	void TransferLossScoretoFullTree(SpeciesNode *node, SpeciesNode *relevant, int diff, const double &weight)
 	{
+		if (outsideRegraftRegion(node)) return;
+		diff = getLossScoreDiff(node, relevant, diff);
+		node->lossScore = node->lossScore + (weight * diff);
 		if (node->child(0) != NULL) {
-			TransferLossScoretoFullTree(node->child(0), weight);
+			TransferLossScoretoFullTree(node->child(0), relevant, diff, weight);
 		}
 		if (node->child(1) != NULL) {
-			TransferLossScoretoFullTree(node->child(1), weight);
-		}
-		
-		if(node->isRelevant == true)
-		{
-			node->lossScore = node->lossScore + (weight * node->LossScoreDiff);
-//			if(node->LossParent != speciestree->root)
-			if(node->parent() != speciestree->root)
-			{		
-
-				SpeciesNode* Temp_Node = node->parent();
-				while(Temp_Node->isRelevant == false)
-				{
-					Temp_Node->lossScore = Temp_Node->lossScore + (weight * node->LossScoreDiff);
-					if(Temp_Node->child(0)->subtreeSize == 0)
-						TransferLossScoreStep2(Temp_Node->child(0), (weight * node->LossScoreDiff));
-					else 
-						TransferLossScoreStep2(Temp_Node->child(1), (weight * node->LossScoreDiff));
-							
-					Temp_Node = Temp_Node->parent();
-				}
-			}
-		}
-	}
-		
-	void TransferLossScoreStep2(SpeciesNode *&tmpnode, double diff)
-	{
-		tmpnode->lossScore = tmpnode->lossScore + diff;
-		
-		if (tmpnode->child(0) != NULL) {
-			TransferLossScoreStep2(tmpnode->child(0), diff);
-		}
-		if (tmpnode->child(1) != NULL) {
-			TransferLossScoreStep2(tmpnode->child(1), diff);
+			TransferLossScoretoFullTree(node->child(1), relevant, diff, weight);
 		}
 	}
-		
-	
-
 	
 // -----------------Losses stuff end-----------------------------------------------------------------------
 
 
+	// ------------------------------------------------------------------------------------------------------
+	// rooting schedule: when the search looks for the best rooting of the unrooted gene trees again
+	// ROOT_EACH = after every move, ROOT_CONVERGED = only when no better species tree is found (followed by a
+	// round that reroots for every regraft position), ROOT_EVERY = after every rootevery moves and when no
+	// better species tree is found, ROOT_CHANGED = after every move, but a gene tree keeps its rooting while the
+	// species topology induced by its leaves is the one it was rooted for (see getInducedKey)
+	RootSchedule rootschedule;
+	int rootevery;
+	unsigned long rootpasses, rootedtrees, keptrootings; // rooting passes, trees rooted and trees kept by them
+	double roottime; // seconds spent in the rooting passes
+
+	void setRootSchedule(const RootSchedule s, const int k) {
+		rootschedule = s;
+		rootevery = k;
+	}
+
 	// find the best rooting of the unrooted gene trees
 	void computeBestRooting() {
-		speciestree->establishOrder();
-		speciestree->preprocessLCA();
-		// process all unrooted trees
-		for(int i=0; i<genetree_unrooted.size(); i++) {
-			GeneTreeUnrooted &tree = *genetree_unrooted[i];
-			createPrimaryMappingUnrooted(tree);
-			
-			resetRelevantTree(speciestree->root);
-			buildRelevantTree(tree);
-			double &score = best_score;
-			score = getScore(tree) * tree.weight + computeGeneLossForRoot(tree) * tree.weight;
-			GeneNodeUnrooted *u = tree.root->child(0);
-			GeneNodeUnrooted *v = tree.root->child(1);
-			best_node[0] = u;
-			best_node[1] = v;
-			#ifdef DEBUG
-			position_counter_debug = 2;
-			if ((u == NULL) || (v == NULL)) EXCEPTION("child = NULL in computeBestRooting" << endl);
-			#endif
-			moveRoot2(tree, u, score);
-			moveRoot2(tree, v, score);
-			#ifdef DEBUG
-			if (position_counter_debug != tree.nodes.size()-1)
-				WARNING("tree traversal failed in computeBestRooting" << position_counter_debug << " != " << tree.nodes.size()-1 << endl);
-			#endif
-			tree.reroot(best_node[0], best_node[1]);
+		const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		rootpasses++;
+		if (!shardpids.empty()) rootShards();
+		else
+		if ((numthreads > 0) && !genetree_unrooted.empty()) computeBestRootingParallel();
+		else {
+			speciestree->establishOrder();
+			speciestree->preprocessLCA();
+			// process all unrooted trees
+			for(int i=0; i<genetree_unrooted.size(); i++) {
+				computeBestRootingTree(*genetree_unrooted[i]);
+			}
+			speciestree->postprocessLCA();
 		}
-		speciestree->postprocessLCA();
+		roottime += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	}
+
+	// find the best rooting of one unrooted gene tree (the LCA lookup table has to be ready)
+	void computeBestRootingTree(GeneTreeUnrooted &tree) {
+		uint64_t key = 0;
+		if (rootschedule == ROOT_CHANGED) {
+			key = getInducedKey(tree);
+			if ((key == tree.rootingkey) && (keyshape == tree.rootingshape) && (tree.root->child(0) == tree.rootingroot[0]) && (tree.root->child(1) == tree.rootingroot[1])) {
+				keptrootings++;
+				return;
+			}
+		}
+		rootedtrees++;
+		updatePrimaryMappingUnrooted(tree);
+		prepareRelevantTree(tree);
+		GeneNodeUnrooted *best[2];
+		unsigned int dup;
+		int loss;
+		Rootings<GeneTreeUnrooted, SpeciesNode>::findBest(tree, tree.weight, best, dup, loss);
+		tree.reroot(best[0], best[1]);
+		tree.rootingkey = key;
+		if (rootschedule == ROOT_CHANGED) tree.rootingshape = keyshape;
+		tree.rootingroot[0] = tree.root->child(0);
+		tree.rootingroot[1] = tree.root->child(1);
+	}
+
+	// output the rooting schedule and the time spent in its passes (trees of all threads and worker processes)
+	void reportRooting() {
+		if (genetree_unrooted.empty() && (shardunrooted == 0)) return;
+		unsigned long rooted = rootedtrees, kept = keptrootings;
+		for (int i=0; i<workers.size(); i++) {
+			rooted += workers[i]->rootedtrees;
+			kept += workers[i]->keptrootings;
+		}
+		msgout << "Gene tree rooting (";
+		switch (rootschedule) {
+			case ROOT_EACH: msgout << "each move"; break;
+			case ROOT_CONVERGED: msgout << "converged"; break;
+			case ROOT_EVERY: msgout << "every " << rootevery << " moves"; break;
+			case ROOT_CHANGED: msgout << "changed trees"; break;
+		}
+		msgout << "): " << rootpasses << " passes, " << rooted << " trees rooted, " << kept << " rootings kept, " << roottime << "s" << endl;
 	}
 
 	// calculate the gene duplication for all rootings and rSPR operation
@@ -1647,10 +1618,13 @@ public:
 				
 				createSecondaryMapping(tree, subtree);
 				computeGeneDuplicationsTriple();
-				resetRelevantTree(speciestree->root);
-				buildRelevantTree(tree);
-				const double score = getScore(tree) * tree.weight;
-				double initLoss  = tree.weight * computeGeneLossForRoot(tree);
+				// the relevant tree does not depend on the rooting, only its loss counters have to be reset
+				resetLossCounters();
+				unsigned int dup;
+				int loss;
+				Rootings<GeneTreeUnrooted, SpeciesNode>::getCost(tree, dup, loss);
+				const double score = dup * tree.weight;
+				double initLoss  = tree.weight * loss;
 				if (score + initLoss < best_score) {
 					best_score = score + initLoss;
 					best_node[1] = c[i];
@@ -1687,33 +1661,321 @@ public:
 		}
 	}
 
-	// calculate the gene duplication for all rootings
-	inline void moveRoot2(GeneTreeUnrooted &tree, GeneNodeUnrooted *p, double &best_score) {
-		GeneNodeUnrooted *c[2];
-		for (int i=0; i<2; i++) c[i] = p->child(i);
-		for (int i=0; i<2; i++) {
-			if (c[i] != NULL) {
-				moveRoot2(tree, c[i], best_score);
-				tree.reroot(c[i], p);
-				#ifdef DEBUG
-				tree.checkStructure();
-				position_counter_debug++;
-				#endif
-				
-				
-				
-				const double score = getScore(tree) * tree.weight + computeGeneLossForRoot(tree) * tree.weight;
-				
+	// move a subtree of the species tree (rSPR move)
+	// the LCA mappings and the costs of the gene trees that change are discarded and recomputed when they are needed
+	void moveSpeciesSubtree(SpeciesNode *subtree, SpeciesNode *target) {
+		speciestree->establishOrder();
+		createSubtreeSet(subtree);
+		for (int i=0; i<genetree_rooted.size(); i++) {
+			discardMapping(*genetree_rooted[i], subtree);
+			keepCost(*genetree_rooted[i]);
+		}
+		for (int i=0; i<genetree_unrooted.size(); i++) {
+			discardMapping(*genetree_unrooted[i], subtree);
+			keepCost(*genetree_unrooted[i]);
+		}
+		speciestree->moveSubtree(subtree, target);
+	}
 
-				
-				
-				if (score < best_score) {
-					best_score = score;
-					best_node[1] = c[i];
-					best_node[0] = p;
+	// prune a candidate subtree to the root for scoring its regraft positions (see SpeciesTree::pruneVirtual)
+	// the order, the LCA lookup table and the costs stay those of the unpruned tree, only the mappings of the
+	// gene trees with species inside and outside the subtree change and they are restored by restoreCandidate
+	void pruneCandidate(SpeciesNode *subtree) {
+		speciestree->establishOrder();
+		speciestree->preprocessLCA();
+		createSubtreeSet(subtree);
+		for (int i=0; i<genetree_rooted.size(); i++) {
+			if (getSpeciesRelation(*genetree_rooted[i]) == SPECIES_BOTH) pruneMapping(*genetree_rooted[i], subtree);
+		}
+		for (int i=0; i<genetree_unrooted.size(); i++) {
+			if (getSpeciesRelation(*genetree_unrooted[i]) == SPECIES_BOTH) pruneMapping(*genetree_unrooted[i], subtree);
+		}
+		speciestree->pruneVirtual(subtree);
+	}
+	void restoreCandidate() {
+		createSubtreeSet(speciestree->pruned);
+		for (int i=0; i<genetree_rooted.size(); i++) {
+			if (getSpeciesRelation(*genetree_rooted[i]) == SPECIES_BOTH) restoreMapping(*genetree_rooted[i]);
+		}
+		for (int i=0; i<genetree_unrooted.size(); i++) {
+			if (getSpeciesRelation(*genetree_unrooted[i]) == SPECIES_BOTH) restoreMapping(*genetree_unrooted[i]);
+		}
+		restorePrunedMapping();
+		speciestree->restorePruned();
+	}
+
+	// ------------------------------------------------------------------------------------------------------
+	// gene trees with a fixed cost: if all species of a gene tree are in the pruned subtree, or (with limited
+	// losses) none of them, moving the subtree does not change the duplications and losses of the gene tree
+	// and it adds the same cost to all regraft positions; the cost is kept until a move can change it
+
+	// species leaves of a subtree (bit i = species node with index i, the order has to be established)
+	vector<uint64_t> subtreeset;
+	void createSubtreeSet(SpeciesNode *subtree) {
+		vector<SpeciesNode*> &nodes = speciestree->nodes;
+		subtreeset.assign((nodes.size() + 63) / 64, 0);
+		for (int i=subtree->begin, last=subtree->end; i<=last; i++) {
+			SpeciesNode *node = nodes[speciestree->E[i]];
+			if (node->isLeaf()) subtreeset[node->idx >> 6] |= uint64_t(1) << (node->idx & 63);
+		}
+	}
+
+	// species of a gene tree in relation to subtreeset
+	enum SpeciesRelation {SPECIES_OUTSIDE, SPECIES_INSIDE, SPECIES_BOTH};
+	template<class GeneTree>
+	SpeciesRelation getSpeciesRelation(GeneTree &tree) {
+		vector<uint64_t> &set = tree.speciesset;
+		if (set.empty()) {
+			set.assign(subtreeset.size(), 0);
+			for (int i=0, last=tree.leafnodes.size(); i<last; i++) {
+				const int idx = tree.leafnodes[i]->getMapping()->idx;
+				set[idx >> 6] |= uint64_t(1) << (idx & 63);
+			}
+		}
+		bool inside = false, outside = false;
+		for (int i=0, last=set.size(); i<last; i++) {
+			if (set[i] & subtreeset[i]) inside = true;
+			if (set[i] & ~subtreeset[i]) outside = true;
+		}
+		if (!inside) return SPECIES_OUTSIDE;
+		return outside ? SPECIES_BOTH : SPECIES_INSIDE;
+	}
+
+	// true if moving the subtree in subtreeset does not change the cost of the gene tree
+	template<class GeneTree>
+	inline bool isFixedCost(GeneTree &tree) {
+		const SpeciesRelation relation = getSpeciesRelation(tree);
+		return (relation == SPECIES_INSIDE) || (LIMIT_LOSSES && (relation == SPECIES_OUTSIDE));
+	}
+
+	// discard the cost of a gene tree before the subtree in subtreeset is moved (if the move can change it)
+	template<class GeneTree>
+	inline void keepCost(GeneTree &tree) {
+		if (tree.costtree != speciestree) return;
+		if (!isFixedCost(tree)) tree.costtree = NULL;
+	}
+
+	// compute the cost of a gene tree if it is not known for the current species tree
+	void updateCost(GeneTreeRooted &tree) {
+		switchCost(tree);
+		if (tree.cost.root[0] != NULL) {
+			costhits++;
+			return;
+		}
+		costmisses++;
+		updatePrimaryMapping(tree);
+		prepareRelevantTree(tree);
+		tree.cost.dup = getScore(tree);
+		tree.cost.loss = computeGeneLossForRoot(tree);
+		tree.cost.root[0] = tree.root;
+	}
+	// (the cost of the current rooting or the best cost of all rootings)
+	void updateCost(GeneTreeUnrooted &tree, const bool reroot) {
+		switchCost(tree);
+		GeneNodeUnrooted *u = tree.root->child(0);
+		GeneNodeUnrooted *v = tree.root->child(1);
+		GeneTreeCost<GeneNodeUnrooted> &cost = tree.cost;
+		if (reroot) {
+			if (cost.bestvalid) {
+				costhits++;
+				return;
+			}
+			costmisses++;
+			updatePrimaryMappingUnrooted(tree);
+			prepareRelevantTree(tree);
+			GeneNodeUnrooted *best[2];
+			Rootings<GeneTreeUnrooted, SpeciesNode>::findBest(tree, tree.weight, best, cost.bestdup, cost.bestloss);
+			cost.bestvalid = true;
+		} else {
+			if (((cost.root[0] == u) && (cost.root[1] == v)) || ((cost.root[0] == v) && (cost.root[1] == u))) {
+				costhits++;
+				return;
+			}
+			costmisses++;
+			updatePrimaryMapping(tree);
+			prepareRelevantTree(tree);
+			cost.dup = getScore(tree);
+			cost.loss = computeGeneLossForRoot(tree);
+			cost.root[0] = u;
+			cost.root[1] = v;
+		}
+	}
+
+	// ------------------------------------------------------------------------------------------------------
+	// cost cache: the duplications and losses of a gene tree only depend on the species topology induced by
+	// its leaves (and on the lengths of the induced edges if the losses are not limited), so the cost is
+	// keyed by a hash of that topology and a gene tree is only rescored when the topology changes (the topology
+	// is kept with the cost and compared when the hashes match); only trees whose cost is the same at all regraft
+	// positions use it (see isFixedCost), the others are scored for every prune candidate
+	unsigned long costhits, costmisses; // costs taken over and computed by updateCost
+
+	// make the cost of a gene tree belong to the current species tree (the LCA structure has to be ready)
+	template<class GeneTree>
+	void switchCost(GeneTree &tree) {
+		if ((tree.costtree == speciestree) && (tree.costversion == speciestree->version)) return;
+		const uint64_t key = getInducedKey(tree);
+		if (!tree.cost.matches(key, keyshape)) {
+			// keep the current cost in the cache and take over the cost of the new topology if there is one
+			int i = 0;
+			if (!tree.cost.isEmpty()) {
+				while ((i < COST_CACHE_SIZE) && !tree.costcache[i].matches(tree.cost.key, tree.cost.shape)) i++;
+				if (i == COST_CACHE_SIZE) {
+					i = tree.costnext;
+					tree.costnext = (tree.costnext + 1) % COST_CACHE_SIZE;
 				}
+				tree.costcache[i] = tree.cost;
+			}
+			for (i=0; i<COST_CACHE_SIZE; i++) {
+				if (tree.costcache[i].isEmpty() || !tree.costcache[i].matches(key, keyshape)) continue;
+				tree.cost = tree.costcache[i];
+				break;
+			}
+			if (i == COST_CACHE_SIZE) tree.cost.clear(key, keyshape);
+		}
+		tree.costtree = speciestree;
+		tree.costversion = speciestree->version;
+	}
+
+	static inline uint64_t mixKey(uint64_t x) {
+		x += 0x9e3779b97f4a7c15ULL;
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+		return x ^ (x >> 31);
+	}
+
+	// hash of the species topology induced by the leaves of a gene tree (the topology itself is left in keyshape)
+	// the species are sorted by their position in the in-order sequence and the LCA of two neighbours is a node
+	// of the induced tree, so the induced tree is built from left to right with a stack of its right path
+	// (a subtree = position of its root, its hash and its node in keytree, the hash does not depend on the child order)
+	struct KeyNode {
+		INT pos;
+		uint64_t hash;
+		int node;
+	};
+	struct KeyTreeNode {
+		INT pos;
+		int child[2]; // -1 = leaf
+		int label; // species index of a leaf, smallest species index below an inner node
+	};
+	vector<INT> keyorder;
+	vector<KeyNode> keyjoin, keyleft;
+	vector<KeyTreeNode> keytree;
+	vector<int> keyshape;
+	template<class GeneTree>
+	uint64_t getInducedKey(GeneTree &tree) {
+		vector<int> &species = tree.speciesidx;
+		if (species.empty()) {
+			for (int i=0, last=tree.leafnodes.size(); i<last; i++) species.push_back(tree.leafnodes[i]->getMapping()->idx);
+			sort(species.begin(), species.end());
+			species.erase(unique(species.begin(), species.end()), species.end());
+		}
+		keyorder.clear();
+		for (int i=0, last=species.size(); i<last; i++) keyorder.push_back(speciestree->R[species[i]]);
+		sort(keyorder.begin(), keyorder.end());
+
+		// keyjoin = nodes on the right path above the current subtree, keyleft = their left subtrees
+		keyjoin.clear();
+		keyleft.clear();
+		keytree.clear();
+		KeyNode right = keyLeaf(keyorder[0]);
+		for (int i=1, last=keyorder.size(); i<last; i++) {
+			KeyNode join = {(INT)rm_query(speciestree->ri, keyorder[i-1], keyorder[i]), 0, -1};
+			while (!keyjoin.empty() && (speciestree->L[keyjoin.back().pos] > speciestree->L[join.pos])) {
+				right = joinKey(keyjoin.back(), keyleft.back(), right);
+				keyjoin.pop_back();
+				keyleft.pop_back();
 			}
+			keyjoin.push_back(join);
+			keyleft.push_back(right);
+			right = keyLeaf(keyorder[i]);
+		}
+		while (!keyjoin.empty()) {
+			right = joinKey(keyjoin.back(), keyleft.back(), right);
+			keyjoin.pop_back();
+			keyleft.pop_back();
+		}
+		keyshape.clear();
+		shapeKey(right.node, speciestree->L[right.pos]);
+		return right.hash;
+	}
+
+	// leaf of the induced tree
+	inline KeyNode keyLeaf(const INT pos) {
+		const KeyTreeNode leaf = {pos, {-1, -1}, (int)speciestree->E[pos]};
+		keytree.push_back(leaf);
+		const KeyNode node = {pos, mixKey(speciestree->E[pos]), (int)keytree.size() - 1};
+		return node;
+	}
+
+	// node of the induced tree with two subtrees
+	inline KeyNode joinKey(KeyNode node, const KeyNode &left, const KeyNode &right) {
+		uint64_t a = left.hash, b = right.hash;
+		if (!LIMIT_LOSSES) {
+			a = mixKey(a + speciestree->L[left.pos] - speciestree->L[node.pos]);
+			b = mixKey(b + speciestree->L[right.pos] - speciestree->L[node.pos]);
+		}
+		node.hash = a < b ? mixKey(a + mixKey(b)) : mixKey(b + mixKey(a));
+		const int label = min(keytree[left.node].label, keytree[right.node].label);
+		const KeyTreeNode inner = {node.pos, {left.node, right.node}, label};
+		keytree.push_back(inner);
+		node.node = keytree.size() - 1;
+		return node;
+	}
+
+	// canonical form of the induced tree in keyshape: preorder with the child of the smaller species index first,
+	// a leaf as its species index and an inner node as -1 (with unlimited losses every node is preceded by the
+	// length of the edge above it)
+	void shapeKey(const int n, const INT level) {
+		const KeyTreeNode &node = keytree[n];
+		if (!LIMIT_LOSSES) keyshape.push_back(speciestree->L[node.pos] - level);
+		if (node.child[0] < 0) {
+			keyshape.push_back(node.label);
+			return;
+		}
+		keyshape.push_back(-1);
+		const int first = keytree[node.child[0]].label < keytree[node.child[1]].label ? 0 : 1;
+		shapeKey(node.child[first], speciestree->L[node.pos]);
+		shapeKey(node.child[1-first], speciestree->L[node.pos]);
+	}
+
+	// output the number of gene tree costs taken over and computed (of all threads and worker processes)
+	void reportCostCache() {
+		unsigned long hits = costhits, misses = costmisses;
+		for (int i=0; i<workers.size(); i++) {
+			hits += workers[i]->costhits;
+			misses += workers[i]->costmisses;
+		}
+		msgout << "Gene tree cost cache (trees with all species inside the pruned subtree";
+		if (LIMIT_LOSSES) msgout << " or all outside it";
+		msgout << "): " << hits << " hits, " << misses << " misses" << endl;
+	}
+
+	// add a cost that is the same for all regraft positions
+	inline void addGeneTreeCost(SpeciesNode *&node, const double &score, const double &loss) {
+		if ((node == NULL) || outsideRegraftRegion(node)) return;
+		node->score += score;
+		node->lossScore = node->lossScore + loss;
+		for (int i=0; i<2; i++)
+			addGeneTreeCost(node->child(i), score, loss);
+	}
+
+	// reset the loss counters of the relevant tree
+	void resetLossCounters() {
+		if (LIMIT_LOSSES) {
+			for (int i=0, last=relevantnodes.size(); i<last; i++) resetLossCounters(relevantnodes[i].second);
+			return;
 		}
+		vector<SpeciesNode*> &nodes = speciestree->nodes;
+		for (int i=0, last=nodes.size(); i<last; i++) resetLossCounters(nodes[i]);
+	}
+	inline void resetLossCounters(SpeciesNode *node) {
+		node->LossScoreDiff = 0;
+		node->lossCounter1 = 0;
+		node->lossCounter2 = 0;
+		node->lossCounter3 = 0;
+		node->lossCounter4 = 0;
+		node->lossCounter5 = 0;
+		node->lossCounter6 = 0;
 	}
 
 	// reset the gene duplication score to 0
@@ -1726,46 +1988,46 @@ public:
 
 	// compute the gene duplication score and add it to the current score
 	inline void computeGeneDuplicationsAdd(SpeciesNode *&node, const double &score, const double &weight) {
-		if (node == NULL) return;
+		if ((node == NULL) || outsideRegraftRegion(node)) return;
 		node->score += score;
 		for (int i=0; i<2; i++) {
-			computeGeneDuplicationsAdd(node->child(i), score + (double(node->gain) - double(node->lost[i])) * weight, weight);
+			computeGeneDuplicationsAdd(node->child(i), score + node->getTripleChange(i, speciestree->tripleepoch) * weight, weight);
 		}
 	}
 
 	// compute the gene duplication score into a temporary variable
 	inline void computeGeneDuplicationsTempReplace(SpeciesNode *&node, const double &score, const double &weight) {
-		if (node == NULL) return;
+		if ((node == NULL) || outsideRegraftRegion(node)) return;
 		node->tempscore = score;
 		for (int i=0; i<2; i++)
-			computeGeneDuplicationsTempReplace(node->child(i), score + (double(node->gain) - double(node->lost[i])) * weight, weight);
+			computeGeneDuplicationsTempReplace(node->child(i), score + node->getTripleChange(i, speciestree->tripleepoch) * weight, weight);
 	}
 	// compute the gene duplication score into a temporary variable (replace is smaller than current score)
 	inline void computeGeneDuplicationsTempMin(SpeciesNode *&node, const double &score, const double &weight) {
-		if (node == NULL) return;
+		if ((node == NULL) || outsideRegraftRegion(node)) return;
 		if (score < node->tempscore) node->tempscore = score;
 		for (int i=0; i<2; i++)
-			computeGeneDuplicationsTempMin(node->child(i), score + (double(node->gain) - double(node->lost[i])) * weight, weight);
+			computeGeneDuplicationsTempMin(node->child(i), score + node->getTripleChange(i, speciestree->tripleepoch) * weight, weight);
 	}
 	
 	
 	
 	inline void computeGeneDuplicationsTempMin2(SpeciesNode *&node, const double &score, double &initLoss, const double &weight) {
-		if (node == NULL) return;
+		if ((node == NULL) || outsideRegraftRegion(node)) return;
 		if ((score + initLoss + (weight * node->LossScoreDiff)) < (node->tempscore + node->lossScoreTemp)) 
 		{
 			node->tempscore = score;
 			node->lossScoreTemp = initLoss + (weight * node->LossScoreDiff);
 		}
 		for (int i=0; i<2; i++)
-			computeGeneDuplicationsTempMin2(node->child(i), score + (double(node->gain) - double(node->lost[i])) * weight, initLoss, weight);
+			computeGeneDuplicationsTempMin2(node->child(i), score + node->getTripleChange(i, speciestree->tripleepoch) * weight, initLoss, weight);
 	}
 	
 	
 	
 	// add the temporary gene duplication score to the final
 	inline void addTempGeneDuplications(SpeciesNode *&node) {
-		if (node == NULL) return;
+		if ((node == NULL) || outsideRegraftRegion(node)) return;
 		node->score += node->tempscore;
 		node->lossScore = node->lossScore + node->lossScoreTemp;
 		for (int i=0; i<2; i++)
@@ -1777,7 +2039,7 @@ public:
 	
 	void copyInitialLossScoreToAllNodes_Temp(SpeciesNode *&node, double initLoss)
 	{
-		if (node == NULL) return;
+		if ((node == NULL) || outsideRegraftRegion(node)) return;
 		node->lossScoreTemp = initLoss;
 		for (int i=0; i<2; i++)
 			copyInitialLossScoreToAllNodes_Temp(node->child(i), initLoss);
@@ -1789,7 +2051,7 @@ public:
 	void computeLossScores_Temp(SpeciesNode *&node, const double &weight)
 	{
 //cout << *node << endl;	
-		// convert counter 5 into counter 3 and counter 6
+		// convert counter 5 into counter 3 and counter 6 (and the path updates into counters 1, 2 and 6)
 		convertCounterFive(node);
 //cout << *node << endl;		
 		// handle counter types 2 and 6, and also 1
@@ -1804,51 +2066,22 @@ public:
 		PreOrderCounterThreeStep2(node, 0);
 //cout << *node << endl;
 		// copies the loss values computed at the relevant nodes to all the other nodes of the species tree.
-		TransferLossScoretoFullTree_Temp(node, weight);
+		TransferLossScoretoFullTree_Temp(getRootChildAbove(node), speciestree->root, 0, weight);
 		
 	}
 	
 	
 	
-		void TransferLossScoretoFullTree_Temp(SpeciesNode *&node, const double &weight)
+	void TransferLossScoretoFullTree_Temp(SpeciesNode *node, SpeciesNode *relevant, int diff, const double &weight)
 	{
+		if (outsideRegraftRegion(node)) return;
+		diff = getLossScoreDiff(node, relevant, diff);
+		node->lossScoreTemp = node->lossScoreTemp + (weight * diff);
 		if (node->child(0) != NULL) {
-			TransferLossScoretoFullTree_Temp(node->child(0), weight);
+			TransferLossScoretoFullTree_Temp(node->child(0), relevant, diff, weight);
 		}
 		if (node->child(1) != NULL) {
-			TransferLossScoretoFullTree_Temp(node->child(1), weight);
-		}
-		
-		if(node->isRelevant == true)
-		{
-			node->lossScoreTemp = node->lossScoreTemp + (weight * node->LossScoreDiff);
-			if(node->parent() != speciestree->root)
-			{		
-
-				SpeciesNode* Temp_Node = node->parent();
-				while(Temp_Node->isRelevant == false)
-				{
-					Temp_Node->lossScoreTemp = Temp_Node->lossScoreTemp + (weight * node->LossScoreDiff);
-					if(Temp_Node->child(0)->subtreeSize == 0)
-						TransferLossScoreStep2_Temp(Temp_Node->child(0), (weight * node->LossScoreDiff));
-					else 
-						TransferLossScoreStep2_Temp(Temp_Node->child(1), (weight * node->LossScoreDiff));
-							
-					Temp_Node = Temp_Node->parent();
-				}
-			}
-		}
-	}
-		
-	void TransferLossScoreStep2_Temp(SpeciesNode *&tmpnode, double diff)
-	{
-		tmpnode->lossScoreTemp = tmpnode->lossScoreTemp + diff;
-		
-		if (tmpnode->child(0) != NULL) {
-			TransferLossScoreStep2_Temp(tmpnode->child(0), diff);
-		}
-		if (tmpnode->child(1) != NULL) {
-			TransferLossScoreStep2_Temp(tmpnode->child(1), diff);
+			TransferLossScoretoFullTree_Temp(node->child(1), relevant, diff, weight);
 		}
 	}
 	
@@ -1858,7 +2091,7 @@ public:
 	void computeLossScores_Temp2(SpeciesNode *&node)
 	{
 //cout << *node << endl;	
-		// convert counter 5 into counter 3 and counter 6
+		// convert counter 5 into counter 3 and counter 6 (and the path updates into counters 1, 2 and 6)
 		convertCounterFive(node);
 //cout << *node << endl;		
 		// handle counter types 2 and 6, and also 1
@@ -1873,50 +2106,21 @@ public:
 		PreOrderCounterThreeStep2(node, 0);
 //cout << *node << endl;
 		// copies the loss values computed at the relevant nodes to all the other nodes of the species tree.
-		TransferLossScoretoFullTree_Temp2(node);
+		TransferLossScoretoFullTree_Temp2(getRootChildAbove(node), speciestree->root, 0);
 		
 	}
 	
 	
-	void TransferLossScoretoFullTree_Temp2(SpeciesNode *&node)
+	void TransferLossScoretoFullTree_Temp2(SpeciesNode *node, SpeciesNode *relevant, int diff)
 	{
+		if (outsideRegraftRegion(node)) return;
+		diff = getLossScoreDiff(node, relevant, diff);
+		node->LossScoreDiff = diff;
 		if (node->child(0) != NULL) {
-			TransferLossScoretoFullTree_Temp2(node->child(0));
+			TransferLossScoretoFullTree_Temp2(node->child(0), relevant, diff);
 		}
 		if (node->child(1) != NULL) {
-			TransferLossScoretoFullTree_Temp2(node->child(1));
-		}
-		
-		if(node->isRelevant == true)
-		{
-//			node->lossScoreTemp = node->lossScoreTemp + node->LossScoreDiff;
-			if(node->parent() != speciestree->root)
-			{		
-
-				SpeciesNode* Temp_Node = node->parent();
-				while(Temp_Node->isRelevant == false)
-				{
-					Temp_Node->LossScoreDiff = node->LossScoreDiff;
-					if(Temp_Node->child(0)->subtreeSize == 0)
-						TransferLossScoreStep2_Temp2(Temp_Node->child(0), node->LossScoreDiff);
-					else 
-						TransferLossScoreStep2_Temp2(Temp_Node->child(1), node->LossScoreDiff);
-							
-					Temp_Node = Temp_Node->parent();
-				}
-			}
-		}
-	}
-		
-	void TransferLossScoreStep2_Temp2(SpeciesNode *&tmpnode, int diff)
-	{
-		tmpnode->LossScoreDiff = diff;
-		
-		if (tmpnode->child(0) != NULL) {
-			TransferLossScoreStep2_Temp2(tmpnode->child(0), diff);
-		}
-		if (tmpnode->child(1) != NULL) {
-			TransferLossScoreStep2_Temp2(tmpnode->child(1), diff);
+			TransferLossScoretoFullTree_Temp2(node->child(1), relevant, diff);
 		}
 	}
 	
@@ -1925,15 +2129,139 @@ public:
 	
 	
 	
+	// ------------------------------------------------------------------------------------------------------
+	// random number generator of the search (owned by the caller)
+	Random *random;
+	void setRandom(Random *random) {
+		this->random = random;
+	}
+
+	// ------------------------------------------------------------------------------------------------------
+	// multi-threaded scoring of the gene trees (see gtp-spr-parallel.h)
+	// each worker holds a replica of the species tree for its private per-node state;
+	// the gene trees are scored in fixed chunks; with integer weights all sums are exact and the chunk results
+	// are summed up, otherwise the workers keep the values each gene tree adds and they are added up in gene tree
+	// order, so the scores are the same as without threads
+	int numthreads;
+	Parallel parallel; // threads score the gene trees of one candidate or whole prune candidates
+	ThreadPool *threadpool;
+	vector<Heuristic*> workers;
+	vector<vector<int> > chunks; // gene trees of each chunk (rooted trees are numbered before unrooted trees)
+	vector<int> chunkorder; // chunks by decreasing estimated cost
+	vector<int> rootingorder; // unrooted gene trees by decreasing size
+	vector<pair<int, int> > rootings; // root edge found by the candidate workers for each unrooted gene tree
+	vector<vector<double> > chunkscore, chunkloss; // per chunk (or per gene tree of a chunk) and species node
+	vector<vector<double> > chunkinitloss; // loss score at the root of each gene tree of a chunk
+	vector<pair<int, int> > treeslot; // (chunk, position in the chunk) of each gene tree
+	bool exactsums; // all gene tree weights are integers
+	bool keepinitloss; // (worker) keep the loss score at the root in initloss instead of adding it
+	double initloss;
+	unsigned int pass; // number of the current scoring pass
+	vector<CandidateScore> candidates; // results of scoreCandidates (indexed like speciestree->nodes)
+
+	// score with n threads (0 = classic single-threaded code path)
+	void setThreads(const int n, const Parallel mode = GENETREES) {
+		numthreads = n;
+		parallel = mode;
+	}
+	void createWorkers();
+	bool integralWeights();
+	double scoringCost(const int t);
+	void reportThreads();
+	void computeGeneDuplicationsParallel(SpeciesNode *subtree, bool reroot);
+	void scoreCandidates(bool reroot, const vector<int> &order);
+	void computeBestRootingParallel();
+
+	// ------------------------------------------------------------------------------------------------------
+	// scoring with local worker processes (see gtp-spr-processes.h)
+	// every worker holds a contiguous share of the gene trees; the workers form a chain coordinator -> worker 1 -> ...
+	// -> worker n -> coordinator and each adds its trees to the per-node scores of its predecessor,
+	// so the scores are summed up in the same order as in a single process; the coordinator frees its own gene trees
+	// once the workers are forked and gets their newick back when they stop
+	int numprocesses;
+	vector<pid_t> shardpids; // running workers (empty = single process)
+	int shardout, shardin; // sockets to the first and from the last worker
+	int shardunrooted; // (coordinator) number of unrooted gene trees held by the workers
+	string shardgenetrees; // (coordinator) newick of the gene trees returned by the workers (see writeGeneTrees)
+	vector<char> shardbuffer;
+
+	// score with n worker processes (0 = single process)
+	void setProcesses(const int n) {
+		numprocesses = n;
+	}
+	void startShards();
+	void stopShards();
+	void sendShards(const int command, const int a = 0, const int b = 0);
+	void rootShards();
+	void requestShardScore(const int j, const bool reroot);
+	void receiveShardScore(const int j);
+	void loadShardScores();
+	void shardWorker(const int in, const int out, const bool first);
+
+	// ------------------------------------------------------------------------------------------------------
+	// radius-limited rSPR neighbourhood: a round only tries the regraft positions within sprradius edges of
+	// the prune point and the scoring walks skip the rest of the species tree; once such a round finds no better
+	// tree, the rounds try all positions until the next move
+	int sprradius; // 0 = all regraft positions in every round
+	int radius; // radius of the current round (0 = all)
+	unsigned int regraftepoch; // nodes stamped with it belong to the region of the current prune candidate
+
+	void setRadius(const int k) {
+		sprradius = radius = k;
+	}
+
+	// first-improvement rounds: the prune candidates are visited in random order and a round ends after
+	// firstimprove candidates with a better tree (0 = every round visits all candidates, see SimpleHeuristicRandom)
+	int firstimprove;
+	void setFirstImprovement(const int k) {
+		firstimprove = k;
+	}
+
+	// stamp the regraft positions within the radius and their ancestors with their distance to the prune point
+	// (sblng = sibling of the pruned subtree before it was pruned, the subtree has to be pruned to the root)
+	void markRegraftRegion(SpeciesNode *sblng) {
+		if (radius == 0) return;
+		if (++regraftepoch == 0) {
+			vector<SpeciesNode*> &nodes = speciestree->nodes;
+			for (int i=0, last=nodes.size(); i<last; i++) nodes[i]->regraftstamp = 0;
+			regraftepoch = 1;
+		}
+		markRegraftSubtree(sblng, 0);
+		SpeciesNode *from = sblng;
+		int d = 1;
+		for (SpeciesNode *node = sblng->parent(); node != speciestree->root; from = node, node = node->parent(), d++) {
+			node->regraftstamp = regraftepoch;
+			node->regraftdistance = d;
+			if (d < radius) markRegraftSubtree(node->child(0) == from ? node->child(1) : node->child(0), d + 1);
+		}
+	}
+	void markRegraftSubtree(SpeciesNode *node, const int d) {
+		if ((node == NULL) || (d > radius)) return;
+		node->regraftstamp = regraftepoch;
+		node->regraftdistance = d;
+		for (int i=0; i<2; i++)
+			markRegraftSubtree(node->child(i), d + 1);
+	}
+
+	// true if no regraft position within the radius is at or below the node; the scores and loss scores of the
+	// regraft positions only depend on their ancestors, so the walks that compute them stop at such nodes
+	// (their scores are left stale and never read)
+	inline bool outsideRegraftRegion(SpeciesNode *node) {
+		return (radius != 0) && (node->regraftstamp != regraftepoch);
+	}
+
 	// travers the tree and call the virtual function scoreComputed for valid rSPR operations
 	inline void forEachCallScoreComputed(SpeciesNode *&subtree, SpeciesNode *&node) {
 		if (node == NULL) return;
-		// call scoreComputed when constraints are not violated
+		// skip subtrees without a regraft position within the radius
+		if ((radius != 0) && (node->regraftstamp != regraftepoch)) return;
+		// call scoreComputed when constraints are not violated (and the node is within the radius)
 		const unsigned int color = subtree->parent()->constraint;
-		if (color == node->constraint) {
+		const bool inside = (radius == 0) || (node->regraftdistance <= radius);
+		if (inside && (color == node->constraint)) {
 			scoreComputed(*node);
 		} else
-		if ((subtree->parent() != node->parent()) && (color == node->parent()->constraint)) {
+		if (inside && (subtree->parent() != node->parent()) && (color == node->parent()->constraint)) {
 			scoreComputed(*node);
 		}
 		for (int i=0; i<2; i++)
@@ -0,0 +1,470 @@
+/*
+Copyright (C) 2024 Mukul S. Bansal (mukul.bansal@uconn.edu).
+Based on open-source code originally written by Andre Wehe and
+Mukul S. Bansal for the DupTree software package.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GTP_SPR_PARALLEL_H
+#define GTP_SPR_PARALLEL_H
+
+// number of gene tree chunks per scoring pass (trees more expensive than one chunk add a chunk of their own)
+#define MAX_SCORING_CHUNKS 256
+
+// ------------------------------------------------------------------------------------------------------------------
+// scores gene trees of a master heuristic on a private replica of the species tree
+class HeuristicWorker : public Heuristic {
+public:
+	Heuristic *master;
+	unsigned int pass; // scoring pass the replica was last synchronized for
+	bool prepared;
+	vector<GeneTreeRooted*> chunkrooted; // gene trees of the chunk being scored (owned by the master)
+	vector<GeneTreeUnrooted*> chunkunrooted;
+
+	HeuristicWorker(Heuristic *master) : master(master) {
+		speciestree = new SpeciesTree;
+		speciestree->replicate(*master->speciestree);
+		engine = master->engine;
+		exactsums = master->exactsums;
+		rootschedule = master->rootschedule;
+		pass = 0;
+		prepared = false;
+	}
+
+	virtual ~HeuristicWorker() {
+		finish();
+	}
+
+	// take over the current species tree of the master (once per scoring pass)
+	void prepare() {
+		if (prepared && (pass == master->pass)) return;
+		finish();
+		speciestree->copyTopology(*master->speciestree);
+		speciestree->establishOrder();
+		speciestree->preprocessLCA();
+		// the walks stop at the same regraft region as those of the master (see Heuristic::outsideRegraftRegion)
+		radius = master->radius;
+		regraftepoch = master->regraftepoch;
+		if (radius != 0) {
+			vector<SpeciesNode*> &nodes = speciestree->nodes;
+			for (int i=0, last=nodes.size(); i<last; i++) nodes[i]->regraftstamp = master->speciestree->nodes[i]->regraftstamp;
+		}
+		pass = master->pass;
+		prepared = true;
+	}
+
+	// release the LCA lookup table
+	void finish() {
+		if (prepared) speciestree->postprocessLCA();
+		prepared = false;
+	}
+
+	// score one chunk of gene trees and store the per-node results in the chunk buffers of the master
+	void scoreChunk(const int chunk, SpeciesNode *prunednode, const bool reroot) {
+		prepare();
+		SpeciesNode *subtree = speciestree->nodes[prunednode->idx];
+		SpeciesNode *sibling = subtree->getSibling();
+		createSubtreeSet(subtree);
+		vector<SpeciesNode*> &nodes = speciestree->nodes;
+		for (int i=0, last=nodes.size(); i<last; i++) {
+			nodes[i]->score = 0;
+			nodes[i]->lossScore = 0;
+			nodes[i]->lossScoreTemp = 0;
+		}
+
+		if (!master->exactsums) {
+			scoreTrees(chunk, subtree, sibling, reroot);
+			return;
+		}
+
+		const int rooted = master->genetree_rooted.size();
+		vector<int> &trees = master->chunks[chunk];
+		chunkrooted.clear();
+		chunkunrooted.clear();
+		for (int i=0, last=trees.size(); i<last; i++) {
+			const int t = trees[i];
+			if (t < rooted) {
+				chunkrooted.push_back(master->genetree_rooted[t]);
+				mapLeaves(*chunkrooted.back(), speciestree);
+			} else {
+				chunkunrooted.push_back(master->genetree_unrooted[t - rooted]);
+				mapLeaves(*chunkunrooted.back(), speciestree);
+			}
+		}
+		computeGeneDuplicationsTrees(chunkrooted, chunkunrooted, subtree, sibling, reroot);
+
+		vector<double> &score = master->chunkscore[chunk];
+		vector<double> &loss = master->chunkloss[chunk];
+		for (int i=0, last=nodes.size(); i<last; i++) {
+			score[i] = nodes[i]->score;
+			loss[i] = nodes[i]->lossScore;
+		}
+	}
+
+	// score the gene trees of a chunk one by one and keep the values each tree adds to the species nodes
+	// (the loss score at the root of a tree is kept apart, the master adds them in the same steps as the serial loop)
+	void scoreTrees(const int chunk, SpeciesNode *subtree, SpeciesNode *sibling, const bool reroot) {
+		const int rooted = master->genetree_rooted.size();
+		const int n = speciestree->nodes.size();
+		vector<SpeciesNode*> &nodes = speciestree->nodes;
+		vector<int> &trees = master->chunks[chunk];
+		vector<double> &score = master->chunkscore[chunk];
+		vector<double> &loss = master->chunkloss[chunk];
+		keepinitloss = true;
+		for (int k=0, last=trees.size(); k<last; k++) {
+			for (int i=0; i<n; i++) {
+				nodes[i]->score = 0;
+				nodes[i]->lossScore = 0;
+			}
+			initloss = 0;
+			const int t = trees[k];
+			if (t < rooted) {
+				GeneTreeRooted &tree = *master->genetree_rooted[t];
+				mapLeaves(tree, speciestree);
+				computeGeneDuplicationsTree(tree, subtree, sibling);
+			} else {
+				GeneTreeUnrooted &tree = *master->genetree_unrooted[t - rooted];
+				mapLeaves(tree, speciestree);
+				computeGeneDuplicationsTree(tree, subtree, sibling, reroot);
+			}
+			for (int i=0; i<n; i++) {
+				score[k*n + i] = nodes[i]->score;
+				loss[k*n + i] = nodes[i]->lossScore;
+			}
+			master->chunkinitloss[chunk][k] = initloss;
+		}
+		keepinitloss = false;
+	}
+
+	// find the best rooting of unrooted gene tree i of the master on the replica
+	void rootTree(const int i) {
+		prepare();
+		GeneTreeUnrooted &tree = *master->genetree_unrooted[i];
+		mapLeaves(tree, speciestree);
+		computeBestRootingTree(tree);
+	}
+
+	void scoreComputed(SpeciesNode &) {}
+	void run(ostream &, const ReRoot) {}
+	double getCurrentScore() { return 0; }
+};
+
+// ------------------------------------------------------------------------------------------------------------------
+// one scoring pass (task i = chunk i of the gene trees)
+class ScoringTask : public ThreadTask {
+public:
+	Heuristic &master;
+	SpeciesNode *subtree;
+	bool reroot;
+
+	ScoringTask(Heuristic &master, SpeciesNode *subtree, const bool reroot) : master(master), subtree(subtree), reroot(reroot) {}
+
+	void process(const int task, const int worker) {
+		((HeuristicWorker*)master.workers[worker])->scoreChunk(task, subtree, reroot);
+	}
+};
+
+// ------------------------------------------------------------------------------------------------------------------
+// evaluates whole prune candidates of a master heuristic on private copies of the species tree and all gene trees
+class CandidateWorker : public Heuristic {
+public:
+	Heuristic *master;
+	unsigned int pass; // scoring pass the copies were last synchronized for
+	CandidateScore *result;
+	bool lca; // LCA lookup table ready for a rooting pass
+
+	CandidateWorker(Heuristic *master) : master(master) {
+		speciestree = new SpeciesTree;
+		speciestree->replicate(*master->speciestree);
+		for (int i=0, last=master->genetree_rooted.size(); i<last; i++) {
+			GeneTreeRooted *tree = new GeneTreeRooted;
+			tree->replicate(*master->genetree_rooted[i], speciestree);
+			genetree_rooted.push_back(tree);
+		}
+		for (int i=0, last=master->genetree_unrooted.size(); i<last; i++) {
+			GeneTreeUnrooted *tree = new GeneTreeUnrooted;
+			tree->replicate(*master->genetree_unrooted[i], speciestree);
+			genetree_unrooted.push_back(tree);
+		}
+		engine = master->engine;
+		exactsums = master->exactsums;
+		rootschedule = master->rootschedule;
+		pass = 0;
+		result = NULL;
+		lca = false;
+	}
+
+	// take over the current species tree and gene tree rootings of the master (once per pass)
+	void prepare() {
+		if (pass == master->pass) return;
+		speciestree->copyTopology(*master->speciestree);
+		for (int i=0, last=genetree_unrooted.size(); i<last; i++) genetree_unrooted[i]->copyRooting(*master->genetree_unrooted[i]);
+		radius = master->radius;
+		pass = master->pass;
+	}
+
+	// prune species node j, score all regraft positions and restore the tree (same steps as the serial search)
+	void evaluate(const int j, const bool reroot, CandidateScore &result) {
+		prepare();
+		result.nodes.clear();
+		SpeciesNode *node = speciestree->nodes[j];
+		if (node == speciestree->root) return;
+		SpeciesNode *sblng = node->getSibling();
+		this->result = &result;
+		pruneCandidate(node);
+		markRegraftRegion(sblng);
+		computeGeneDuplications(node, reroot);
+		restoreCandidate();
+		this->result = NULL;
+	}
+
+	// find the best rooting of unrooted gene tree i on the copy and record its root edge for the master
+	void rootTree(const int i) {
+		prepare();
+		if (!lca) {
+			speciestree->establishOrder();
+			speciestree->preprocessLCA();
+			lca = true;
+		}
+		computeBestRootingTree(*genetree_unrooted[i]);
+		genetree_unrooted[i]->getRooting(master->rootings[i].first, master->rootings[i].second);
+	}
+
+	// release the LCA lookup table of a rooting pass
+	void finish() {
+		if (lca) speciestree->postprocessLCA();
+		lca = false;
+	}
+
+	// keep the lowest score and all positions reaching it
+	void scoreComputed(SpeciesNode &node) {
+		const double &genedup = node.score;
+		const double &geneloss = node.lossScore;
+		if (result->nodes.empty() || (genedup + geneloss < result->score)) {
+			result->nodes.clear();
+			result->score = genedup + geneloss;
+			result->genedup = genedup;
+			result->geneloss = geneloss;
+		}
+		if (genedup + geneloss == result->score) result->nodes.push_back(node.idx);
+	}
+
+	void run(ostream &, const ReRoot) {}
+	double getCurrentScore() { return 0; }
+};
+
+// ------------------------------------------------------------------------------------------------------------------
+// one candidate pass (task j = prune species node j)
+class CandidateTask : public ThreadTask {
+public:
+	Heuristic &master;
+	bool reroot;
+
+	CandidateTask(Heuristic &master, const bool reroot) : master(master), reroot(reroot) {}
+
+	void process(const int task, const int worker) {
+		((CandidateWorker*)master.workers[worker])->evaluate(task, reroot, master.candidates[task]);
+	}
+};
+
+// ------------------------------------------------------------------------------------------------------------------
+// one rooting pass (task i = unrooted gene tree i)
+class RootingTask : public ThreadTask {
+public:
+	Heuristic &master;
+
+	RootingTask(Heuristic &master) : master(master) {}
+
+	void process(const int task, const int worker) {
+		if (master.parallel == CANDIDATES) ((CandidateWorker*)master.workers[worker])->rootTree(task);
+		else ((HeuristicWorker*)master.workers[worker])->rootTree(task);
+	}
+};
+
+// ------------------------------------------------------------------------------------------------------------------
+// create the thread pool, one worker per thread and the gene tree chunks
+void Heuristic::createWorkers() {
+	speciestree->assignIndex();
+	threadpool = new ThreadPool(numthreads);
+	if (parallel == CANDIDATES) {
+		for (int i=0; i<threadpool->size(); i++) workers.push_back(new CandidateWorker(this));
+		candidates.resize(speciestree->nodes.size());
+		return;
+	}
+	for (int i=0; i<threadpool->size(); i++) workers.push_back(new HeuristicWorker(this));
+
+	// split the gene trees into chunks of similar estimated cost (independent of the number of threads)
+	// a tree that costs more than a chunk forms a chunk of its own, the other trees are grouped in input order
+	const int rooted = genetree_rooted.size();
+	const int total = rooted + genetree_unrooted.size();
+	vector<double> cost(total);
+	double sum = 0;
+	for (int t=0; t<total; t++) {
+		cost[t] = scoringCost(t);
+		sum += cost[t];
+	}
+	const double target = sum / (total < MAX_SCORING_CHUNKS ? total : MAX_SCORING_CHUNKS);
+	vector<double> chunkcost;
+	vector<int> group;
+	double groupcost = 0;
+	for (int t=0; t<total; t++) {
+		if (cost[t] >= target) {
+			chunks.push_back(vector<int>(1, t));
+			chunkcost.push_back(cost[t]);
+			continue;
+		}
+		group.push_back(t);
+		groupcost += cost[t];
+		if (groupcost >= target) {
+			chunks.push_back(group);
+			chunkcost.push_back(groupcost);
+			group.clear();
+			groupcost = 0;
+		}
+	}
+	if (!group.empty()) {
+		chunks.push_back(group);
+		chunkcost.push_back(groupcost);
+	}
+
+	// the thread pool deals out the most expensive chunks first
+	multimap<double, int, greater<double> > sorted;
+	for (int c=0, last=chunks.size(); c<last; c++) sorted.insert(pair<double, int>(chunkcost[c], c));
+	for (multimap<double, int, greater<double> >::iterator itr=sorted.begin(); itr!=sorted.end(); itr++) chunkorder.push_back(itr->second);
+
+	// with non-integer weights the order of the additions matters and every gene tree keeps its own values
+	const int n = speciestree->nodes.size();
+	exactsums = integralWeights();
+	treeslot.resize(total);
+	for (int c=0, last=chunks.size(); c<last; c++) {
+		const int size = exactsums ? 1 : chunks[c].size();
+		chunkscore.push_back(vector<double>(size * n, 0));
+		chunkloss.push_back(vector<double>(size * n, 0));
+		chunkinitloss.push_back(vector<double>(size, 0));
+		for (int k=0, klast=chunks[c].size(); k<klast; k++) treeslot[chunks[c][k]] = pair<int, int>(c, k);
+	}
+}
+
+// true if all gene tree weights are integers (sums of their scores are exact in any order)
+bool Heuristic::integralWeights() {
+	for (int i=0, last=genetree_rooted.size(); i<last; i++) {
+		if (genetree_rooted[i]->weight != floor(genetree_rooted[i]->weight)) return false;
+	}
+	for (int i=0, last=genetree_unrooted.size(); i<last; i++) {
+		if (genetree_unrooted[i]->weight != floor(genetree_unrooted[i]->weight)) return false;
+	}
+	return true;
+}
+
+// estimated cost of scoring gene tree t (rooted trees are numbered before unrooted trees)
+// every tree walks the species tree a few times; unrooted trees are scored once for every rooting
+double Heuristic::scoringCost(const int t) {
+	const double n = speciestree->nodes.size();
+	const int rooted = genetree_rooted.size();
+	if (t < rooted) return genetree_rooted[t]->nodes.size() + n;
+	const double m = genetree_unrooted[t - rooted]->nodes.size();
+	return m * (m + n);
+}
+
+// output the time each thread spent working and the number of tasks it processed
+void Heuristic::reportThreads() {
+	if (threadpool == NULL) return;
+	for (int i=0; i<threadpool->size(); i++) {
+		msgout << "Thread " << i+1 << ": busy " << threadpool->busy[i] << "s, " << threadpool->tasks[i] << " tasks (" << threadpool->stolen[i] << " stolen)" << endl;
+	}
+}
+
+// score all gene trees with the thread pool and sum up the chunk results into the species nodes
+void Heuristic::computeGeneDuplicationsParallel(SpeciesNode *subtree, bool reroot) {
+	if (threadpool == NULL) createWorkers();
+	pass++;
+	ScoringTask task(*this, subtree, reroot);
+	threadpool->run(task, chunkorder);
+	for (int i=0, last=workers.size(); i<last; i++) ((HeuristicWorker*)workers[i])->finish();
+
+	vector<SpeciesNode*> &nodes = speciestree->nodes;
+	const int n = nodes.size();
+	if (exactsums) {
+		// reduction in chunk order
+		for (int i=0; i<n; i++) {
+			double score = 0, loss = 0;
+			for (int c=0, clast=chunkscore.size(); c<clast; c++) {
+				score += chunkscore[c][i];
+				loss += chunkloss[c][i];
+			}
+			nodes[i]->score = score;
+			nodes[i]->lossScore = loss;
+		}
+	} else {
+		// reduction in gene tree order with the additions of the serial loop
+		SpeciesNode *sibling = subtree->getSibling();
+		for (int i=0; i<n; i++) {
+			nodes[i]->score = 0;
+			nodes[i]->lossScore = 0;
+		}
+		for (int t=0, last=treeslot.size(); t<last; t++) {
+			const int c = treeslot[t].first;
+			const int k = treeslot[t].second;
+			const double *score = &chunkscore[c][k*n];
+			const double *loss = &chunkloss[c][k*n];
+			copyInitialLossScoreToAllNodes(sibling, chunkinitloss[c][k]);
+			for (int i=0; i<n; i++) {
+				nodes[i]->score += score[i];
+				nodes[i]->lossScore = nodes[i]->lossScore + loss[i];
+			}
+		}
+	}
+
+	// the leaf mappings have to point into the species tree of the master again
+	for (int i=0, last=genetree_rooted.size(); i<last; i++) mapLeaves(*genetree_rooted[i], speciestree);
+	for (int i=0, last=genetree_unrooted.size(); i<last; i++) mapLeaves(*genetree_unrooted[i], speciestree);
+}
+
+// find the best rooting of all unrooted gene trees with the thread pool
+// every tree is rooted on the species tree replica of a worker, so the result is the same as for the serial pass
+void Heuristic::computeBestRootingParallel() {
+	if (threadpool == NULL) createWorkers();
+	if (rootingorder.empty()) {
+		multimap<int, int, greater<int> > sorted;
+		for (int i=0, last=genetree_unrooted.size(); i<last; i++) sorted.insert(pair<int, int>(genetree_unrooted[i]->nodes.size(), i));
+		for (multimap<int, int, greater<int> >::iterator itr=sorted.begin(); itr!=sorted.end(); itr++) rootingorder.push_back(itr->second);
+	}
+	pass++;
+	if (parallel == CANDIDATES) {
+		// the workers copy the master rootings before any tree is rerooted, the new root edges are applied afterwards
+		rootings.resize(genetree_unrooted.size());
+		for (int i=0, last=workers.size(); i<last; i++) ((CandidateWorker*)workers[i])->prepare();
+	}
+	RootingTask task(*this);
+	threadpool->run(task, rootingorder);
+	if (parallel == CANDIDATES) {
+		for (int i=0, last=workers.size(); i<last; i++) ((CandidateWorker*)workers[i])->finish();
+		for (int i=0, last=genetree_unrooted.size(); i<last; i++) genetree_unrooted[i]->rootAt(rootings[i].first, rootings[i].second);
+		return;
+	}
+	for (int i=0, last=workers.size(); i<last; i++) ((HeuristicWorker*)workers[i])->finish();
+	for (int i=0, last=genetree_unrooted.size(); i<last; i++) mapLeaves(*genetree_unrooted[i], speciestree);
+}
+
+// evaluate the prune candidates in 'order' (species node indices) with the thread pool
+// the results are stored in candidates[j] for prune node j
+void Heuristic::scoreCandidates(bool reroot, const vector<int> &order) {
+	if (threadpool == NULL) createWorkers();
+	pass++;
+	CandidateTask task(*this, reroot);
+	threadpool->run(task, order);
+}
+
+#endif
@@ -0,0 +1,296 @@
+/*
+Copyright (C) 2024 Mukul S. Bansal (mukul.bansal@uconn.edu).
+Based on open-source code originally written by Andre Wehe and
+Mukul S. Bansal for the DupTree software package.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GTP_SPR_PROCESSES_H
+#define GTP_SPR_PROCESSES_H
+
+// number of prune candidates the coordinator keeps in the worker chain at the same time
+#define SHARD_WINDOW 64
+
+// commands passed along the worker chain (every worker executes a command and forwards it to its successor)
+enum ShardCommand {
+	SHARD_SCORE, // score prune candidate a (b = rerooting, c = regraft radius), payload: score and loss score of every species node
+	SHARD_MOVE, // move subtree a to node b
+	SHARD_ROOT, // find the best rooting of the unrooted gene trees
+	SHARD_GENETREES, // collect the gene trees, payload: newick of every gene tree in the current rooting
+	SHARD_CACHE, // add up the cost cache and rooting counters, payload: hits, misses, rooted trees and kept rootings
+	SHARD_QUIT // stop the worker
+};
+
+struct ShardMessage {
+	int command, a, b, c;
+	int size; // bytes of payload following the message
+};
+
+// ------------------------------------------------------------------------------------------------------------------
+// blocking socket i/o (a closed socket means that the other process has died)
+void writeShard(const int fd, const void *data, size_t size) {
+	const char *p = (const char*)data;
+	while (size > 0) {
+		const ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			EXCEPTION("worker process failed (" << strerror(errno) << ")" << endl);
+		}
+		p += n;
+		size -= n;
+	}
+}
+
+void readShard(const int fd, void *data, size_t size) {
+	char *p = (char*)data;
+	while (size > 0) {
+		const ssize_t n = read(fd, p, size);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			EXCEPTION("worker process failed (" << strerror(errno) << ")" << endl);
+		}
+		if (n == 0) EXCEPTION("worker process failed" << endl);
+		p += n;
+		size -= n;
+	}
+}
+
+void writeShard(const int fd, const ShardMessage &msg, const vector<char> &payload) {
+	writeShard(fd, &msg, sizeof(msg));
+	if (msg.size > 0) writeShard(fd, &payload[0], msg.size);
+}
+
+void readShard(const int fd, ShardMessage &msg, vector<char> &payload) {
+	readShard(fd, &msg, sizeof(msg));
+	payload.resize(msg.size);
+	if (msg.size > 0) readShard(fd, &payload[0], msg.size);
+}
+
+// ------------------------------------------------------------------------------------------------------------------
+// fork the worker processes and give each a contiguous share of the gene trees of about the same cost
+void Heuristic::startShards() {
+	const int rooted = genetree_rooted.size();
+	const int total = rooted + genetree_unrooted.size();
+	const int n = numprocesses < total ? numprocesses : total;
+	if (n < 1) return;
+	speciestree->assignIndex();
+
+	// first[s] = first gene tree of worker s (rooted trees are numbered before unrooted trees)
+	double sum = 0;
+	for (int t=0; t<total; t++) sum += scoringCost(t);
+	vector<int> first(n+1, total);
+	first[0] = 0;
+	double cost = 0;
+	for (int t=0, s=1; (t<total) && (s<n); t++) {
+		cost += scoringCost(t);
+		if ((cost >= sum * s / n) || (total - (t+1) == n - s)) first[s++] = t+1;
+	}
+
+	// chain of sockets: coordinator -> worker 1 -> ... -> worker n -> coordinator
+	vector<int> in(n+1), out(n+1); // link s is written by process s (0 = coordinator) and read by process s+1
+	for (int s=0; s<=n; s++) {
+		int fd[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, fd) != 0) EXCEPTION("cannot create sockets for the worker processes" << endl);
+		out[s] = fd[0];
+		in[s] = fd[1];
+	}
+	cout.flush();
+	cerr.flush();
+	for (int s=1; s<=n; s++) {
+		const pid_t pid = fork();
+		if (pid < 0) EXCEPTION("cannot start worker process " << s << endl);
+		if (pid > 0) {
+			shardpids.push_back(pid);
+			continue;
+		}
+
+		// worker process: keep its own share of the gene trees only
+		signal(SIGINT, SIG_IGN);
+		for (int k=0; k<=n; k++) {
+			if (k != s-1) close(in[k]);
+			if (k != s) close(out[k]);
+		}
+		shardpids.clear();
+		numprocesses = 0;
+		for (int t=total-1; t>=0; t--) {
+			if ((t >= first[s-1]) && (t < first[s])) continue;
+			if (t < rooted) {
+				delete genetree_rooted[t];
+				genetree_rooted.erase(genetree_rooted.begin() + t);
+			} else {
+				delete genetree_unrooted[t - rooted];
+				genetree_unrooted.erase(genetree_unrooted.begin() + (t - rooted));
+			}
+		}
+		shardWorker(in[s-1], out[s], s == 1);
+		_exit(0);
+	}
+	for (int s=0; s<=n; s++) {
+		if (s != 0) close(out[s]);
+		if (s != n) close(in[s]);
+	}
+	shardout = out[0];
+	shardin = in[n];
+
+	// the coordinator only combines the scores of the workers and gets the gene trees back from them in stopShards
+	shardunrooted = genetree_unrooted.size();
+	for (int i=0, last=genetree_rooted.size(); i<last; i++) delete genetree_rooted[i];
+	for (int i=0, last=genetree_unrooted.size(); i<last; i++) delete genetree_unrooted[i];
+	genetree_rooted.clear();
+	genetree_unrooted.clear();
+
+	msgout << "Scoring with " << n << " worker processes (gene trees";
+	for (int s=0; s<n; s++) {
+		msgout << " " << first[s]+1;
+		if (first[s+1] > first[s]+1) msgout << "-" << first[s+1];
+	}
+	msgout << ")" << endl;
+}
+
+// take over the gene trees in the rootings chosen by the workers and stop them
+void Heuristic::stopShards() {
+	if (shardpids.empty()) return;
+	ShardMessage msg = {SHARD_GENETREES, 0, 0, 0, 0};
+	vector<char> payload;
+	writeShard(shardout, msg, payload);
+	readShard(shardin, msg, payload);
+	shardgenetrees.assign(payload.begin(), payload.end());
+
+	msg.command = SHARD_CACHE;
+	msg.size = 4 * sizeof(uint64_t);
+	payload.assign(msg.size, 0);
+	writeShard(shardout, msg, payload);
+	readShard(shardin, msg, payload);
+	const uint64_t *counter = (const uint64_t*)&payload[0];
+	costhits += counter[0];
+	costmisses += counter[1];
+	rootedtrees += counter[2];
+	keptrootings += counter[3];
+
+	sendShards(SHARD_QUIT);
+	for (int i=0, last=shardpids.size(); i<last; i++) waitpid(shardpids[i], NULL, 0);
+	shardpids.clear();
+	close(shardout);
+	close(shardin);
+}
+
+// send a command without payload along the chain and wait until it has passed all workers
+void Heuristic::sendShards(const int command, const int a, const int b) {
+	ShardMessage msg = {command, a, b, 0, 0};
+	vector<char> payload;
+	writeShard(shardout, msg, payload);
+	readShard(shardin, msg, payload);
+}
+
+// find the best rooting of the unrooted gene trees in all workers
+void Heuristic::rootShards() {
+	sendShards(SHARD_ROOT);
+}
+
+// let the chain score prune candidate j (the result is picked up by receiveShardScore)
+void Heuristic::requestShardScore(const int j, const bool reroot) {
+	ShardMessage msg = {SHARD_SCORE, j, reroot, radius, 0};
+	vector<char> payload;
+	writeShard(shardout, msg, payload);
+}
+
+// load the scores of prune candidate j into the species nodes once it has passed the chain
+// (the candidate has to be pruned already, the workers return the candidates in the order they were requested)
+void Heuristic::receiveShardScore(const int j) {
+	ShardMessage msg;
+	readShard(shardin, msg, shardbuffer);
+	if ((msg.command != SHARD_SCORE) || (msg.a != j)) EXCEPTION("worker processes out of step" << endl);
+	loadShardScores();
+}
+
+void Heuristic::loadShardScores() {
+	const double *value = (const double*)&shardbuffer[0];
+	vector<SpeciesNode*> &nodes = speciestree->nodes;
+	for (int i=0, last=nodes.size(); i<last; i++) {
+		nodes[i]->score = value[2*i];
+		nodes[i]->lossScore = value[2*i+1];
+	}
+}
+
+// ------------------------------------------------------------------------------------------------------------------
+// main loop of a worker process: execute the commands of the predecessor and forward them to the successor
+// the first worker starts the scores of a prune candidate, the others add their gene trees to the scores they receive
+void Heuristic::shardWorker(const int in, const int out, const bool first) {
+	ShardMessage msg;
+	vector<char> payload;
+	const int n = speciestree->nodes.size();
+	for (;;) {
+		readShard(in, msg, payload);
+		switch (msg.command) {
+			case SHARD_SCORE: {
+				SpeciesNode *subtree = speciestree->nodes[msg.a];
+				SpeciesNode *sblng = subtree->getSibling();
+				pruneCandidate(subtree);
+				radius = msg.c;
+				markRegraftRegion(sblng);
+				SpeciesNode *sibling = subtree->getSibling();
+
+				// the same steps as the single process scoring (computeGeneDuplications)
+				resetGeneDuplications(sibling);
+				resetLossStuff(speciestree->root);
+				if (!first) {
+					shardbuffer.swap(payload);
+					loadShardScores();
+				}
+				computeGeneDuplicationsTrees(genetree_rooted, genetree_unrooted, subtree, sibling, msg.b);
+				speciestree->postprocessLCA();
+
+				payload.resize(2 * n * sizeof(double));
+				double *value = (double*)&payload[0];
+				for (int i=0; i<n; i++) {
+					value[2*i] = speciestree->nodes[i]->score;
+					value[2*i+1] = speciestree->nodes[i]->lossScore;
+				}
+				msg.size = payload.size();
+				restoreCandidate();
+			} break;
+			case SHARD_MOVE: {
+				moveSpeciesSubtree(speciestree->nodes[msg.a], speciestree->nodes[msg.b]);
+			} break;
+			case SHARD_ROOT: {
+				computeBestRooting();
+			} break;
+			case SHARD_GENETREES: {
+				// the shares are contiguous and the rooted trees come first, so the chain appends them in input order
+				ostringstream os;
+				for (int i=0, last=genetree_rooted.size(); i<last; i++) {
+					genetree_rooted[i]->tree2newick(os); os << endl;
+				}
+				for (int i=0, last=genetree_unrooted.size(); i<last; i++) {
+					os << "[&U]"; genetree_unrooted[i]->tree2newick(os); os << endl;
+				}
+				const string text = os.str();
+				payload.insert(payload.end(), text.begin(), text.end());
+				msg.size = payload.size();
+			} break;
+			case SHARD_CACHE: {
+				uint64_t *counter = (uint64_t*)&payload[0];
+				counter[0] += costhits;
+				counter[1] += costmisses;
+				counter[2] += rootedtrees;
+				counter[3] += keptrootings;
+			} break;
+		}
+		writeShard(out, msg, payload);
+		if (msg.command == SHARD_QUIT) return;
+	}
+}
+
+#endif
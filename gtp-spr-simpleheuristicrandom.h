@@ -20,6 +20,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef GTP_SPR_SIMPLEHEURISTICRANDOM_H
 #define GTP_SPR_SIMPLEHEURISTICRANDOM_H
 
+// prune candidates per thread evaluated at a time in first-improvement rounds with --parallel candidates
+#define FIRST_IMPROVEMENT_BATCH 4
+
 class SimpleHeuristicRandom :  public Heuristic {
 protected:
         double Best_score;
@@ -34,6 +37,16 @@ protected:
 	int j, index;
 	Format format;
 	unsigned int countTotal;
+
+	// prune candidates of the current round in the order they are visited
+	// (first-improvement rounds: random order, the round ends after firstimprove improving candidates)
+	vector<int> pruneorder;
+	bool firstround; // the current round is a first-improvement round
+	bool converged; // first-improvement rounds have become too long, all later rounds visit every candidate
+	double roundscore; // score of the species tree at the start of the round
+	double candidatescore; // lowest score of the current prune candidate
+	int improving, visited; // prune candidates of the current round with a better tree and in total
+	int unrootedmoves; // moves since the last rooting pass
 
 	
 	
@@ -42,6 +55,7 @@ public:
 	{
                 const double &genedup = node.score;
 				const double &geneloss = node.lossScore;
+		if (genedup + geneloss < candidatescore) candidatescore = genedup + geneloss;
                 if(genedup + geneloss < Best_score)
                 {
 			update = true;
@@ -73,12 +87,61 @@ public:
 		temp.BestNewLocation = NULL;
 		countTotal = 0;
 		queue.push_back(temp);
+		firstround = false;
+		converged = false;
+		candidatescore = UINT_MAX;
+		unrootedmoves = 0;
+	}
+
+	// prepare the next round
+	void startRound() {
+		const int n = speciestree->nodes.size();
+		pruneorder.resize(n);
+		for (int i=0; i<n; i++) pruneorder[i] = i;
+		// the first round has to find the score of the initial species tree
+		firstround = (firstimprove > 0) && !converged && (Best_score != UINT_MAX);
+		if (firstround) {
+			for (int i=n-1; i>0; i--) swap(pruneorder[i], pruneorder[random->below(i+1)]);
+		}
+		roundscore = Best_score;
+		candidatescore = UINT_MAX;
+		improving = visited = 0;
+	}
+
+	// called after every prune candidate (candidatescore = its lowest score), true if the round ends here
+	bool endCandidate() {
+		visited++;
+		const bool improved = candidatescore < roundscore;
+		candidatescore = UINT_MAX;
+		if (!firstround) return false;
+		if (improved) improving++;
+		return improving >= firstimprove;
+	}
+
+	// a first-improvement round that visited more than half of the candidates is close to a local optimum,
+	// the later rounds look for the best move of all candidates
+	void endRound() {
+		if (firstround && (2 * visited > speciestree->nodes.size())) converged = true;
+	}
+
+	// find the best rooting of the unrooted gene trees for a changed species tree as given by the rooting
+	// schedule (stuck = no better species tree was found, the gene trees are always rooted then)
+	void rootGeneTrees(const bool stuck) {
+		if (!stuck) {
+			unrootedmoves++;
+			if (rootschedule == ROOT_CONVERGED) return;
+			if ((rootschedule == ROOT_EVERY) && (unrootedmoves < rootevery)) return;
+		}
+		computeBestRooting();
+		unrootedmoves = 0;
 	}
 
 	void run(ostream &os, const ReRoot reroot)
 	{
 		bool rerooting = (reroot == ALL);
                 createLeafMapping();
+		exactsums = integralWeights();
+		if (numprocesses > 0) startShards();
 
                 int num_nodes, Left_Right;
                 num_nodes = speciestree->nodes.size();
@@ -87,9 +150,14 @@ public:
 
 		msgout << "Computing...\n";
 		do {
-
-                        for ( j=0; j< num_nodes;j++)
+			startRound();
+			if (!shardpids.empty()) scoreCandidatesSharded(rerooting);
+			else
+			if ((numthreads > 0) && (parallel == CANDIDATES)) scoreCandidatesParallel(rerooting);
+			else
+                        for (int k=0; k<num_nodes; k++)
                         {
+                                j = pruneorder[k];
 
                                 SpeciesNode *prnt, *sblng;
 
@@ -104,20 +172,36 @@ public:
                                 sblng = prnt->child(1-Left_Right);
 
 // checkConstraintsStructure(speciestree->root,0);
-                                speciestree->moveSubtree(speciestree->nodes[j], speciestree->root);
+                                pruneCandidate(speciestree->nodes[j]);
+                                markRegraftRegion(sblng);
 
                                 computeGeneDuplications(speciestree->nodes[j], rerooting);
-                                speciestree->moveSubtree(speciestree->root->child(Left_Right), sblng);
+                                restoreCandidate();
 // checkConstraintsStructure(speciestree->root,0);
+                                if (endCandidate()) break;
 
                         }
-						
+			endRound();
 
 
+			if ((update == false) && (radius != 0)) {
+				// no better tree within the radius: the next rounds try all regraft positions
+				radius = 0;
+				queue.clear();
+			} else
 			if (update == false) {
 
-				computeBestRooting();
-				if (rerooting) break;
+				rootGeneTrees(true);
+				if (rerooting) {
+					// an island may continue from a better species tree found by another island
+					if (!migrate(true)) break;
+					rootGeneTrees(false);
+					rerooting = (reroot == ALL);
+					radius = sprradius;
+					queue.clear();
+					update = false;
+					continue;
+				}
 				rerooting = true;
 	
 				queue.clear();
@@ -132,21 +216,30 @@ public:
 			
 			if (!queue.empty()) {
 				countTotal++;
-				index = rand()%queue.size();
+				index = random->below(queue.size());
 				old.BestSubtreeRoot = queue[index].BestSubtreeRoot;
 				old.BestNewLocation = queue[index].BestNewLocation;
-				speciestree->moveSubtree(old.BestSubtreeRoot, old.BestNewLocation);
-				computeBestRooting();
-				
+				moveSpeciesSubtree(old.BestSubtreeRoot, old.BestNewLocation);
+				if (!shardpids.empty()) sendShards(SHARD_MOVE, old.BestSubtreeRoot->idx, old.BestNewLocation->idx);
+				rootGeneTrees(false);
+				radius = sprradius;
+			}
+			if (migrate(false)) {
+				rootGeneTrees(false);
+				rerooting = (reroot == ALL);
+				radius = sprradius;
 			}
 		} while(!interruptFlag);
 
+		stopShards();
 		msgout << endl;
 		msgout << "Number of rSPR tree edit operations: " << countTotal << endl;
+		reportThreads();
+		reportCostCache();
+		reportRooting();
 
 		// output score
 		msgout << "Final weighted reconciliation cost: " << getCurrentScore() << endl;
-		WEIGHTED_RECON_COST = getCurrentScore();
 		speciestree->tree2newick(os); os << endl;
 
 
@@ -156,6 +249,85 @@ public:
 	double getCurrentScore() {
 		return Best_score;
 	}
+
+	// called after every round of run() (stuck = no improving rSPR operation is left, the search would end)
+	// returns true if the species tree has been replaced and Best_score set to its score
+	virtual bool migrate(const bool stuck) {
+		return false;
+	}
+
+	// number of rSPR tree edit operations applied by run()
+	unsigned int getMoveCount() {
+		return countTotal;
+	}
+
+	// evaluate the prune candidates with the thread pool and merge their best positions in the order of the
+	// serial loop, so the queue (and the chosen move) is the same as without threads
+	// (first-improvement rounds evaluate a few candidates per thread at a time until the round ends)
+	void scoreCandidatesParallel(const bool rerooting) {
+		const int n = pruneorder.size();
+		const int batch = firstround ? FIRST_IMPROVEMENT_BATCH * numthreads : n;
+		for (int b=0; b<n; b+=batch) {
+			vector<int> order(pruneorder.begin() + b, pruneorder.begin() + (b + batch < n ? b + batch : n));
+			scoreCandidates(rerooting, order);
+			for (int k=0; k<order.size(); k++) {
+				j = order[k];
+				CandidateScore &candidate = candidates[j];
+				if (candidate.nodes.empty()) continue;
+				mergeCandidate(candidate);
+				candidatescore = candidate.score;
+				if (endCandidate()) return;
+			}
+		}
+	}
+
+	// take over the best positions of prune candidate j
+	void mergeCandidate(CandidateScore &candidate) {
+		if (candidate.score < Best_score) {
+			update = true;
+			queue.clear();
+			Best_score = candidate.score;
+			msgout<< "\rCurrent best score: " << candidate.genedup  << " + " << candidate.geneloss << " = " <<Best_score<<"         ";
+			flush(cout);
+		} else if ((update == false) || (candidate.score != Best_score)) return;
+		temp.BestSubtreeRoot = speciestree->nodes[j];
+		for (int i=0; i<candidate.nodes.size(); i++) {
+			temp.BestNewLocation = speciestree->nodes[candidate.nodes[i]];
+			queue.push_back(temp);
+		}
+	}
+
+	// evaluate the prune candidates with the worker processes in the order of the serial loop
+	// up to SHARD_WINDOW candidates are in the worker chain while the coordinator handles the finished ones
+	void scoreCandidatesSharded(const bool rerooting) {
+		const int num_nodes = speciestree->nodes.size();
+		int next = 0;
+		for (int k=0; k<num_nodes; k++) {
+			for (; (next < num_nodes) && (next < k + SHARD_WINDOW); next++) {
+				if (speciestree->nodes[pruneorder[next]] != speciestree->root) requestShardScore(pruneorder[next], rerooting);
+			}
+			j = pruneorder[k];
+			if (speciestree->nodes[j] == speciestree->root) continue;
+
+			SpeciesNode *subtree = speciestree->nodes[j];
+			SpeciesNode *prnt = subtree->parent();
+			const int side = prnt->child(0) == subtree ? 0 : 1;
+			SpeciesNode *sblng = prnt->child(1-side);
+			speciestree->pruneVirtual(subtree);
+			markRegraftRegion(sblng);
+			receiveShardScore(j);
+			SpeciesNode *sibling = subtree->getSibling();
+			forEachCallScoreComputed(subtree, sibling);
+			speciestree->restorePruned();
+			if (endCandidate()) {
+				// the candidates still in the worker chain are not needed any more
+				for (k++; k<next; k++) {
+					if (speciestree->nodes[pruneorder[k]] != speciestree->root) receiveShardScore(pruneorder[k]);
+				}
+				return;
+			}
+		}
+	}
 };
 
 #endif
@@ -110,9 +110,11 @@ class SecondaryMapping {
 public:
 	// mapping
 	T* secondarymapping;
+	unsigned int secondarystamp; // epoch of the gene tree the mapping was established for (older = no mapping)
 
 	SecondaryMapping() {
 		secondarymapping = NULL;
+		secondarystamp = 0;
 	}
 
 	// check if contained in Gamma-Tree
@@ -157,15 +159,32 @@ ostream & operator << (ostream & os, Order & m) {
 class GeneDuplication {
 public:
 	unsigned int gain, lost[2];
+	unsigned int triplestamp; // epoch the triple belongs to (an older triple counts as 0)
 	double score, tempscore;
 
 	GeneDuplication() {
 		gain = 0;
 		for (int i=0; i<2; i++) lost[i] = 0;
+		triplestamp = 0;
 		score = 0;
 		tempscore = 0;
 	}
 
+	// clear a triple of an older epoch before it is changed
+	inline void touchTriple(const unsigned int epoch) {
+		if (triplestamp == epoch) return;
+		gain = 0;
+		lost[0] = 0;
+		lost[1] = 0;
+		triplestamp = epoch;
+	}
+
+	// change of the score below child i
+	inline double getTripleChange(const int i, const unsigned int epoch) {
+		if (triplestamp != epoch) return 0;
+		return double(gain) - double(lost[i]);
+	}
+
 	friend ostream & operator << (ostream & os, GeneDuplication & m);
 };
 
@@ -180,7 +199,9 @@ ostream & operator << (ostream & os, GeneDuplication & m) {
 class GeneLoss {
 public:
 	int subtreeSize, lossCounter1, lossCounter2, lossCounter3, lossCounter4, lossCounter5, lossCounter6, LossScoreDiff, nodeDepth; 
+	int lossPath1, lossPath2, lossPath6; // path updates of the counters 1, 2 and 6 (endpoint differences, see convertPathCounters)
 	double lossScore, lossScoreTemp;
+	double lossMark; // loss score still to be added to the whole subtree (see Heuristic::addLossMarks)
 	
 	//subtreeSize counts the number leaves in the subtree that have mappings from the gene tree
 	// nodeDepth is 1 for root. 
@@ -194,8 +215,12 @@ public:
 		lossCounter4 = 0;
 		lossCounter5 = 0;
 		lossCounter6 = 0;
+		lossPath1 = 0;
+		lossPath2 = 0;
+		lossPath6 = 0;
 		lossScore = 0;
 		lossScoreTemp = 0;
+		lossMark = 0;
 		LossScoreDiff = 0;
 		nodeDepth = 0;
 		isRelevant = false;
@@ -234,9 +259,38 @@ public:
 	int idx;
 	unsigned int constraint;
 	SpeciesNode *LossParent, *LossChild1, *LossChild2 ;
+	unsigned int relevantstamp; // epoch of the relevant tree the loss fields belong to (older = all 0)
+	unsigned int regraftstamp; // regraft region of a prune candidate the node belongs to (see Heuristic::markRegraftRegion)
+	int regraftdistance; // edges between the node and the prune point
 
 	SpeciesNode(SpeciesNode  *parent = NULL) : TreeNodeRooted<SpeciesNode>(parent) {
 		constraint = 0;
+		LossParent = LossChild1 = LossChild2 = NULL;
+		relevantstamp = 0;
+		regraftstamp = 0;
+		regraftdistance = 0;
+	}
+
+	// clear the loss fields of an older relevant tree before they are used
+	inline void touchRelevant(const unsigned int epoch) {
+		if (relevantstamp == epoch) return;
+		subtreeSize = 0;
+		LossScoreDiff = 0;
+		isRelevant = false;
+		nodeDepth = 0;
+		lossCounter1 = 0;
+		lossCounter2 = 0;
+		lossCounter3 = 0;
+		lossCounter4 = 0;
+		lossCounter5 = 0;
+		lossCounter6 = 0;
+		lossPath1 = 0;
+		lossPath2 = 0;
+		lossPath6 = 0;
+		LossParent = NULL;
+		LossChild1 = NULL;
+		LossChild2 = NULL;
+		relevantstamp = epoch;
 	}
 	
 	SpeciesNode *&getLossSibling()
@@ -329,6 +383,9 @@ class GeneNodeUnrooted : public TreeNodeUnrooted<GeneNodeUnrooted>, public Prima
 public:
 	using PrimaryMappingUnrooted<SpeciesNode>::getMapping;
 
+	// duplications and losses of the subtree seen from direction i (for all rootings, -1 = not computed yet)
+	int rootingdup[3], rootingloss[3];
+
 	GeneNodeUnrooted(GeneNodeUnrooted *parent = NULL) : TreeNodeUnrooted<GeneNodeUnrooted>(parent) {}
 
 	// get LCA mapping in rooted direction
@@ -400,10 +457,20 @@ class SpeciesTree : public TreeIO<Tree<SpeciesNode, NamedSpeciesNode> > {
 public:
 	SpeciesTree() {
 		R = NULL; E = NULL; L = NULL;
+		ri = NULL;
+		sequenced = false;
+		pruned = NULL;
+		version = 0;
+		tripleepoch = 0;
+		relevantepoch = 0;
+		fullrelevant = false;
 	}
 
 	virtual ~SpeciesTree() {
-		delete [] L, E, R;
+		if (ri != NULL) rm_free(ri);
+		delete [] L;
+		delete [] E;
+		delete [] R;
 	}
 
 	// create a species node from the input - analyses comments for [&CONSTRAINT]
@@ -442,14 +509,27 @@ public:
 		}
 	}
 
-	// set the gene duplication triple to 0
+	// set the gene duplication triple to 0 (a new epoch, the triples are cleared when they are changed)
+	unsigned int tripleepoch;
 	void resetGeneDubTriple() {
-		for (vector<SpeciesNode*>::iterator itr = nodes.begin(); itr != nodes.end(); itr++) {
-			SpeciesNode &t = **itr;
-			t.gain = 0;
-			t.lost[0] = 0;
-			t.lost[1] = 0;
-		}
+		if (++tripleepoch != 0) return;
+		for (vector<SpeciesNode*>::iterator itr = nodes.begin(); itr != nodes.end(); itr++) (*itr)->triplestamp = 0;
+		tripleepoch = 1;
+	}
+
+	// start a new relevant tree (a new epoch, the loss fields are cleared when they are used)
+	// fullrelevant = the relevant tree is the whole species tree in its current shape (cleared by every
+	// relinking of the nodes, see Heuristic::prepareRelevantTree)
+	unsigned int relevantepoch;
+	bool fullrelevant;
+	inline bool inRelevantTree(SpeciesNode *node) {
+		return (node->relevantstamp == relevantepoch) && node->isRelevant;
+	}
+	void resetRelevantTree() {
+		fullrelevant = false;
+		if (++relevantepoch != 0) return;
+		for (vector<SpeciesNode*>::iterator itr = nodes.begin(); itr != nodes.end(); itr++) (*itr)->relevantstamp = 0;
+		relevantepoch = 1;
 	}
 
 	// assigns each node an index
@@ -457,10 +537,82 @@ public:
 		for (int i = 0; i < nodes.size(); i++) nodes[i]->idx = i;
 	}
 
-	// node numbering + range of subtree
+	// create the nodes of a copy of another species tree (node i of this tree corresponds to node i of src)
+	void replicate(SpeciesTree &src) {
+		for (int i = 0; i < src.nodes.size(); i++) {
+			SpeciesNode *node = src.nodes[i];
+			SpeciesNode *copy;
+			if (node->isLeaf()) {
+				NamedSpeciesNode *leaf = new NamedSpeciesNode(((NamedSpeciesNode*)node)->getName());
+				leafnodes.push_back(leaf);
+				copy = leaf;
+			} else copy = new SpeciesNode();
+			copy->idx = i;
+			copy->constraint = node->constraint;
+			nodes.push_back(copy);
+		}
+		copyTopology(src);
+	}
+
+	// take over topology and constraints of a species tree on the same species but with its own nodes
+	// (leaves are matched by name, the internal nodes of src are assigned to the internal nodes of this tree
+	// in order; the indices of src have to be assigned)
+	void adoptTopology(SpeciesTree &src) {
+		if (src.nodes.size() != nodes.size()) EXCEPTION("adoptTopology: species sets differ");
+		changeTopology();
+		map<string, SpeciesNode*> leaves;
+		vector<SpeciesNode*> internal;
+		for (int i = 0; i < nodes.size(); i++) {
+			if (nodes[i]->isLeaf()) leaves[((NamedSpeciesNode*)nodes[i])->getName()] = nodes[i];
+			else internal.push_back(nodes[i]);
+		}
+		vector<SpeciesNode*> copy(src.nodes.size());
+		for (int i = 0, next = 0; i < src.nodes.size(); i++) {
+			SpeciesNode *node = src.nodes[i];
+			if (node->isLeaf()) {
+				map<string, SpeciesNode*>::iterator itr = leaves.find(((NamedSpeciesNode*)node)->getName());
+				if (itr == leaves.end()) EXCEPTION("adoptTopology: species sets differ");
+				copy[i] = itr->second;
+			} else {
+				if (next == internal.size()) EXCEPTION("adoptTopology: species sets differ");
+				copy[i] = internal[next++];
+			}
+		}
+		for (int i = 0; i < src.nodes.size(); i++) {
+			SpeciesNode *node = src.nodes[i];
+			copy[i]->constraint = node->constraint;
+			copy[i]->parent() = node->parent() == NULL ? NULL : copy[node->parent()->idx];
+			for (int j = 0; j < 2; j++)
+				copy[i]->child(j) = node->child(j) == NULL ? NULL : copy[node->child(j)->idx];
+		}
+		root = copy[src.root->idx];
+	}
+
+	// number of topology changes that are not made by moveSubtree (the LCA mappings of the gene trees
+	// kept for an older version are discarded completely, the in-order sequence is rebuilt)
+	unsigned int version;
+	inline void changeTopology() {
+		version++;
+		sequenced = false;
+		fullrelevant = false;
+	}
+
+	// take over the topology of a species tree created by replicate()
+	void copyTopology(SpeciesTree &src) {
+		changeTopology();
+		for (int i = 0; i < src.nodes.size(); i++) {
+			SpeciesNode *node = src.nodes[i];
+			SpeciesNode *copy = nodes[i];
+			copy->parent() = node->parent() == NULL ? NULL : nodes[node->parent()->idx];
+			for (int j = 0; j < 2; j++)
+				copy->child(j) = node->child(j) == NULL ? NULL : nodes[node->child(j)->idx];
+		}
+		root = nodes[src.root->idx];
+	}
+
+	// node numbering + range of subtree (kept up to date by moveSubtree once established)
 	inline void establishOrder() {
-		int pos = 0;
-		establishOrderDFS(root, pos);
+		if (!sequenced) createSequence();
 	}
 	inline void establishOrderDFS(SpeciesNode *node, int &pos) {
 		node->begin = pos;
@@ -477,10 +629,26 @@ public:
 	}
 
 	// preprocess the LCA computation (build RMQ)
+	// the in-order sequence, the order and the lookup table are kept between the calls; moveSubtree
+	// splices the sequence and the lookup table is refreshed in its memory
 	INT *R; // first occurences in sequence
 	VAL *E, *L; // sequence - E:nodes, L:levels
 	struct rmqinfo *ri; // lookup table
+	bool sequenced; // E, L, R and the order belong to the current topology
+	bool refreshed; // the lookup table belongs to the current sequence
 	void preprocessLCA() {
+		if (!sequenced) createSequence();
+		if (ri == NULL) ri = rm_query_preprocess(L, nodes.size());
+		else if (!refreshed) rm_query_refresh(ri);
+		refreshed = true;
+	}
+
+	// clean up of LCA computation (the lookup table is kept for the next preprocessing)
+	void postprocessLCA() {
+	}
+
+	// create the in-order sequence and the order of the current topology
+	void createSequence() {
 		const int n = nodes.size();
 		if ((E == NULL) || (L == NULL) || (R == NULL)) {
 			assignIndex();
@@ -488,19 +656,153 @@ public:
 			delete [] E; E = new VAL[n];
 			delete [] L; L = new VAL[n];
 		}
+		int pos = 0;
+		establishOrderDFS(root, pos);
 		VAL *e = &E[0], *l = &L[0];
 		createInorderSequence(root, e, l);
 		for (int i=n-1; i>=0; i--) R[E[i]] = i;
-		ri = rm_query_preprocess(L, n);
+		sequenced = true;
+		refreshed = false;
 	}
 
-	// clean up of LCA computation
-	void postprocessLCA() {
-		rm_free(ri);
+	// moves a subtree to a new location in the tree (see Tree::moveSubtree)
+	inline void moveSubtree(SpeciesNode *subroot, SpeciesNode *targetnode) {
+		#ifdef DEBUG
+		if (pruned != NULL) EXCEPTION("moveSubtree of a virtually pruned species tree" << endl);
+		#endif
+		if (sequenced && (subroot->parent() != targetnode)) spliceSequence(subroot, targetnode);
+		fullrelevant = false;
+		Tree<SpeciesNode, NamedSpeciesNode>::moveSubtree(subroot, targetnode);
+	}
+
+	// move the subtree and its parent node in the in-order sequence next to the target (before the topology
+	// is changed): the subtree of the sibling moves up one level, the subtree of the target moves down one
+	// level and the parent node takes over the level of the target
+	vector<VAL> spliceE, spliceL;
+	vector<int> splicestack;
+	void spliceSequence(SpeciesNode *subroot, SpeciesNode *targetnode) {
+		const int n = nodes.size();
+		SpeciesNode *p = subroot->parent();
+		SpeciesNode *s = subroot->getSibling();
+		const bool left = p->child(0) == subroot;
+
+		// remaining sequence without the subtree and the parent node (positions b0..b1) followed by the subtree
+		const int b0 = left ? subroot->begin : p->no;
+		const int b1 = left ? p->no : subroot->end;
+		spliceE.resize(n);
+		spliceL.resize(n);
+		int m = 0;
+		for (int i=0; i<n; i++) {
+			if ((i >= b0) && (i <= b1)) continue;
+			spliceE[m] = E[i];
+			spliceL[m] = ((i >= s->begin) && (i <= s->end)) ? L[i] - 1 : L[i];
+			m++;
+		}
+		for (int i=subroot->begin, k=m; i<=subroot->end; i++, k++) {
+			spliceE[k] = E[i];
+			spliceL[k] = L[i];
+		}
+
+		// range and level of the target in the remaining sequence (the range of an ancestor can start or end in the block)
+		const int size = b1 - b0 + 1;
+		const int tb = targetnode->begin > b1 ? targetnode->begin - size : (targetnode->begin >= b0 ? b0 : targetnode->begin);
+		const int te = targetnode->end > b1 ? targetnode->end - size : (targetnode->end >= b0 ? b0 - 1 : targetnode->end);
+		const int tn = targetnode->no > b1 ? targetnode->no - size : targetnode->no;
+		const VAL level = spliceL[tn];
+
+		// insert the subtree and the parent node next to the target (the subtree keeps its side)
+		int pos = 0;
+		for (int i=0; i<tb; i++) {
+			E[pos] = spliceE[i];
+			L[pos++] = spliceL[i];
+		}
+		if (left) spliceSubtree(subroot, m, level + 1, pos);
+		else spliceTarget(tb, te, pos);
+		E[pos] = p->idx;
+		L[pos++] = level;
+		if (left) spliceTarget(tb, te, pos);
+		else spliceSubtree(subroot, m, level + 1, pos);
+		for (int i=te+1; i<m; i++) {
+			E[pos] = spliceE[i];
+			L[pos++] = spliceL[i];
+		}
+
+		// positions and order
+		for (int i=0; i<n; i++) {
+			R[E[i]] = i;
+			nodes[E[i]]->no = i;
+		}
+		// the subtree of a node is the range around its position with higher levels
+		splicestack.clear();
+		for (int i=0; i<n; i++) {
+			while (!splicestack.empty() && (L[splicestack.back()] >= L[i])) splicestack.pop_back();
+			nodes[E[i]]->begin = splicestack.empty() ? 0 : splicestack.back() + 1;
+			splicestack.push_back(i);
+		}
+		splicestack.clear();
+		for (int i=n-1; i>=0; i--) {
+			while (!splicestack.empty() && (L[splicestack.back()] >= L[i])) splicestack.pop_back();
+			nodes[E[i]]->end = splicestack.empty() ? n - 1 : splicestack.back() - 1;
+			splicestack.push_back(i);
+		}
+		refreshed = false;
+	}
+	inline void spliceTarget(const int tb, const int te, int &pos) {
+		for (int i=tb; i<=te; i++) {
+			E[pos] = spliceE[i];
+			L[pos++] = spliceL[i] + 1;
+		}
+	}
+	inline void spliceSubtree(SpeciesNode *subroot, const int m, const VAL level, int &pos) {
+		const VAL sublevel = spliceL[m + subroot->no - subroot->begin];
+		for (int i=m, last=m+subroot->end-subroot->begin; i<=last; i++) {
+			E[pos] = spliceE[i];
+			L[pos++] = spliceL[i] - sublevel + level;
+		}
+	}
+
+	// ------------------------------------------------------------------------------------------------------
+	// virtual pruning of a candidate subtree: the subtree is moved to the root by relinking its parent only,
+	// the order, the in-order sequence and the lookup table stay those of the unpruned tree; pruning does not
+	// change the order of the nodes inside or outside the subtree, so the ranges still tell if a node is in the
+	// subtree and getLCA answers for the pruned tree (the LCA with a node on the other side is the new root)
+	SpeciesNode *pruned; // subtree pruned virtually (NULL = none)
+	SpeciesNode *prunedsibling; // its sibling before pruning
+	inline void pruneVirtual(SpeciesNode *subroot) {
+		pruned = subroot;
+		prunedsibling = subroot->getSibling();
+		Tree<SpeciesNode, NamedSpeciesNode>::moveSubtree(subroot, root);
+		fullrelevant = false;
+	}
+	inline void restorePruned() {
+		Tree<SpeciesNode, NamedSpeciesNode>::moveSubtree(pruned, prunedsibling);
+		pruned = NULL;
+		fullrelevant = false;
+	}
+	inline bool isPruned(SpeciesNode *node) {
+		return (pruned->begin <= node->no) && (node->no <= pruned->end);
+	}
+
+	// true if node a is an ancestor of node v or v itself (in the pruned tree while a subtree is pruned)
+	inline bool isAncestor(SpeciesNode *a, SpeciesNode *v) {
+		if (pruned != NULL) {
+			if ((a == root) || (v == root)) return a == root;
+			if (isPruned(a) != isPruned(v)) return false;
+		}
+		return (a->begin <= v->no) && (v->no <= a->end);
+	}
+
+	// sort key of the preorder (in the pruned tree while a subtree is pruned): the root, then the subtrees of
+	// child 0 and child 1, within a subtree by range (an ancestor comes before its descendants)
+	inline uint64_t getPreorderKey(SpeciesNode *node) {
+		uint64_t side = 0;
+		if ((pruned != NULL) && (node != root)) side = (isPruned(node) == (root->child(0) == pruned)) ? 1 : 2;
+		return (side << 48) | (uint64_t(node->begin) << 24) | uint64_t(nodes.size() - node->end);
 	}
 
 	// return the LCA of 2 species nodes
 	SpeciesNode*& getLCA(SpeciesNode* &u, SpeciesNode* &v) {
+		if ((pruned != NULL) && ((u == root) || (v == root) || (isPruned(u) != isPruned(v)))) return nodes[root->idx];
 		const INT uidx = R[u->idx];
 		const INT vidx = R[v->idx];
 		int y;
@@ -520,15 +822,110 @@ public:
 	}
 };
 
+// ------------------------------------------------------------------------------------------------------------------
+// number of earlier species topologies a gene tree keeps the cost for (see Heuristic::switchCost)
+#define COST_CACHE_SIZE 4
+
+// duplications and losses of a gene tree for one species topology induced by its leaves
+// root = root children of the rooting of dup and loss (NULL = not computed), best = best of all rootings
+template<class GeneNode>
+struct GeneTreeCost {
+	uint64_t key; // hash of the induced species topology (see Heuristic::getInducedKey)
+	vector<int> shape; // the induced species topology itself, compared when the keys match
+	GeneNode *root[2];
+	unsigned int dup, bestdup;
+	int loss, bestloss;
+	bool bestvalid;
+
+	GeneTreeCost() {
+		key = 0;
+		root[0] = root[1] = NULL;
+		bestvalid = false;
+	}
+
+	inline void clear(const uint64_t key, const vector<int> &shape) {
+		this->key = key;
+		this->shape = shape;
+		root[0] = root[1] = NULL;
+		bestvalid = false;
+	}
+
+	inline bool matches(const uint64_t key, const vector<int> &shape) {
+		return (this->key == key) && (this->shape == shape);
+	}
+
+	inline bool isEmpty() {
+		return (root[0] == NULL) && !bestvalid;
+	}
+};
+
 // ------------------------------------------------------------------------------------------------------------------
 // a rooted binary gene tree
 class GeneTreeRooted : public TreeIO<Tree<GeneNodeRooted, NamedGeneNodeRooted> > {
 public:
 	double weight;
+
+	// species tree (and its version) the LCA mappings that are not NULL are valid for
+	SpeciesTree *mappingtree;
+	unsigned int mappingversion;
+
+	// epoch of the secondary mapping (only nodes stamped with it have a secondary mapping)
+	unsigned int secondaryepoch;
+
+	// species of the leaves (bit i = species node with index i, empty until it is needed)
+	// and their indices (each species once, empty until it is needed)
+	vector<uint64_t> speciesset;
+	vector<int> speciesidx;
+
+	// duplications and losses for the species tree (and its version) in costtree; they stay valid while
+	// the species tree is only changed by moves that do not change them (see Heuristic::keepCost)
+	// the costs of earlier induced species topologies are kept in costcache (costnext = next entry replaced)
+	SpeciesTree *costtree;
+	unsigned int costversion;
+	GeneTreeCost<GeneNodeRooted> cost, costcache[COST_CACHE_SIZE];
+	int costnext;
+
+	GeneTreeRooted() {
+		mappingtree = NULL;
+		mappingversion = 0;
+		secondaryepoch = 1;
+		costtree = NULL;
+		costversion = 0;
+		costnext = 0;
+	}
+
 	inline bool isRooted() {
 		weight = 1;
 		return true;
 	}
+
+	// create a copy of another gene tree (node i is the copy of node i in src)
+	// the leaves are mapped to the nodes with the same index in the given species tree (unmapped if target is NULL)
+	void replicate(GeneTreeRooted &src, SpeciesTree *target) {
+		map<GeneNodeRooted*, GeneNodeRooted*> copy;
+		copy[NULL] = NULL;
+		for (int i = 0; i < src.leafnodes.size(); i++) {
+			NamedGeneNodeRooted *node = src.leafnodes[i];
+			NamedGeneNodeRooted *leaf = new NamedGeneNodeRooted(node->getName());
+			if (target != NULL) {
+				SpeciesNode *mapping = target->nodes[node->getMapping()->idx];
+				leaf->setMapping(mapping);
+			}
+			leafnodes.push_back(leaf);
+			copy[node] = leaf;
+		}
+		for (int i = 0; i < src.nodes.size(); i++) {
+			if (copy.find(src.nodes[i]) == copy.end()) copy[src.nodes[i]] = new GeneNodeRooted();
+			nodes.push_back(copy[src.nodes[i]]);
+		}
+		for (int i = 0; i < src.nodes.size(); i++) {
+			GeneNodeRooted *node = src.nodes[i];
+			nodes[i]->parent() = copy[node->parent()];
+			for (int j = 0; j < 2; j++) nodes[i]->child(j) = copy[node->child(j)];
+		}
+		root = copy[src.root];
+		weight = src.weight;
+	}
 };
 
 // a quasi unrooted binary gene tree
@@ -536,6 +933,43 @@ public:
 class GeneTreeUnrooted : public TreeIO<Tree<GeneNodeUnrooted, NamedGeneNodeUnrooted> > {
 public:
 	double weight;
+
+	// species tree (and its version) the LCA mappings that are not NULL are valid for
+	SpeciesTree *mappingtree;
+	unsigned int mappingversion;
+
+	// epoch of the secondary mapping (only nodes stamped with it have a secondary mapping)
+	unsigned int secondaryepoch;
+
+	// species of the leaves (bit i = species node with index i, empty until it is needed)
+	// and their indices (each species once, empty until it is needed)
+	vector<uint64_t> speciesset;
+	vector<int> speciesidx;
+
+	// duplications and losses for the species tree (and its version) in costtree; they stay valid while
+	// the species tree is only changed by moves that do not change them (see Heuristic::keepCost)
+	// the costs of earlier induced species topologies are kept in costcache (costnext = next entry replaced)
+	SpeciesTree *costtree;
+	unsigned int costversion;
+	GeneTreeCost<GeneNodeUnrooted> cost, costcache[COST_CACHE_SIZE];
+	int costnext;
+
+	// hash and shape of the induced species topology and the root children of the last best rooting (see Heuristic::rootschedule)
+	uint64_t rootingkey;
+	vector<int> rootingshape;
+	GeneNodeUnrooted *rootingroot[2];
+
+	GeneTreeUnrooted() {
+		mappingtree = NULL;
+		mappingversion = 0;
+		secondaryepoch = 1;
+		costtree = NULL;
+		costversion = 0;
+		costnext = 0;
+		rootingkey = 0;
+		rootingroot[0] = rootingroot[1] = NULL;
+	}
+
 	inline bool isRooted() {
 		weight = 1;
 		return false;
@@ -555,6 +989,54 @@ public:
 		rerootDFS(node->child(0), node);
 		rerootDFS(node->child(1), node);
 	}
+
+	// create a copy of another gene tree (node i is the copy of node i in src)
+	// the leaves are mapped to the nodes with the same index in the given species tree (unmapped if target is NULL)
+	void replicate(GeneTreeUnrooted &src, SpeciesTree *target) {
+		map<GeneNodeUnrooted*, GeneNodeUnrooted*> copy;
+		copy[NULL] = NULL;
+		for (int i = 0; i < src.leafnodes.size(); i++) {
+			NamedGeneNodeUnrooted *node = src.leafnodes[i];
+			NamedGeneNodeUnrooted *leaf = new NamedGeneNodeUnrooted(node->getName());
+			if (target != NULL) {
+				SpeciesNode *mapping = target->nodes[node->getMapping()->idx];
+				leaf->setMapping(mapping);
+			}
+			leafnodes.push_back(leaf);
+			copy[node] = leaf;
+		}
+		for (int i = 0; i < src.nodes.size(); i++) {
+			if (copy.find(src.nodes[i]) == copy.end()) copy[src.nodes[i]] = new GeneNodeUnrooted();
+			nodes.push_back(copy[src.nodes[i]]);
+		}
+		for (int i = 0; i < src.nodes.size(); i++) {
+			GeneNodeUnrooted *node = src.nodes[i];
+			for (int j = 0; j < 3; j++) nodes[i]->direction(j) = copy[node->direction(j)];
+			nodes[i]->parentno = node->parentno;
+		}
+		root = copy[src.root];
+		weight = src.weight;
+	}
+
+	// move the root into the same edge as the root of a copy created by replicate()
+	void copyRooting(GeneTreeUnrooted &src) {
+		int ui, vi;
+		src.getRooting(ui, vi);
+		rootAt(ui, vi);
+	}
+
+	// indices of the two root children (the edge for rootAt)
+	void getRooting(int &ui, int &vi) {
+		ui = vi = 0;
+		while (nodes[ui] != root->child(0)) ui++;
+		while (nodes[vi] != root->child(1)) vi++;
+	}
+
+	// move the root into the edge between node ui and node vi (root children in this order)
+	void rootAt(const int ui, const int vi) {
+		if ((root->child(0) == nodes[ui]) && (root->child(1) == nodes[vi])) return;
+		reroot(nodes[ui], nodes[vi]);
+	}
 };
 
 // ==================================================================================================================
@@ -591,15 +1073,22 @@ public:
 	// ------------------------------------------------------------------------------------------------------
 	// read all trees from the input
 	void readTrees(Input &input) {
-		// read the species tree
+		readSpeciesTree(input);
+		readGeneTrees(input);
+	}
+
+	// read the species tree from the input
+	void readSpeciesTree(Input &input) {
 		speciestree = new SpeciesTree;
 		speciestree->constraintcounter = 0;
 		if (speciestree->stream2tree(input)) {
 //			msgout << "Input species tree of " << speciestree->leafnodes.size() << " taxa" << endl;
 		} else EXCEPTION("missing input for species tree " << input.getLastPos());
 		speciestree->colorSpeciesTreeByConstraints();
+	}
 
-		// read all gene trees
+	// read all gene trees from the input
+	void readGeneTrees(Input &input) {
 		for (;;) {
 			string str;
 			bool rooted = true;
@@ -645,6 +1134,20 @@ public:
 		msgout << genetree_rooted.size() <<" rooted and " << genetree_unrooted.size() << " unrooted input gene trees total" << endl;
 	}
 
+	// take over copies of the gene trees of another tree set (the leaves are mapped by createLeafMapping)
+	void copyGeneTrees(TreeSet &src) {
+		for (int i=0; i<src.genetree_rooted.size(); i++) {
+			GeneTreeRooted *tree = new GeneTreeRooted;
+			tree->replicate(*src.genetree_rooted[i], NULL);
+			genetree_rooted.push_back(tree);
+		}
+		for (int i=0; i<src.genetree_unrooted.size(); i++) {
+			GeneTreeUnrooted *tree = new GeneTreeUnrooted;
+			tree->replicate(*src.genetree_unrooted[i], NULL);
+			genetree_unrooted.push_back(tree);
+		}
+	}
+
 	// ------------------------------------------------------------------------------------------------------
 	// establish the initial primary mapping
 	// mappings between the leaf nodes of gene trees and the species tree; according to their names
@@ -716,6 +1219,15 @@ public:
 		}
 	}
 
+	// redirect the leaf mappings of a gene tree to the nodes with the same index in another species tree
+	template<class GeneTree>
+	void mapLeaves(GeneTree &tree, SpeciesTree *target) {
+		for (int i=0, last=tree.leafnodes.size(); i<last; i++) {
+			SpeciesNode *node = target->nodes[tree.leafnodes[i]->getMapping()->idx];
+			tree.leafnodes[i]->setMapping(node);
+		}
+	}
+
 	// ------------------------------------------------------------------------------------------------------
 	// establish the LCA mapping between one gene tree and the species tree
 	void createPrimaryMapping(GeneTreeRooted &tree) {
@@ -724,6 +1236,7 @@ public:
 			GeneNodeRooted &t = **itr;
 			if (!t.isLeaf()) t.resetMapping();
 		}
+		tree.mappingtree = NULL;
 		// establish LCA mapping
 		getLCA(tree.root, tree.root->parent(), speciestree->E, speciestree->R, speciestree->ri);
 	}
@@ -733,6 +1246,7 @@ public:
 			GeneNodeUnrooted &t = **itr;
 			if (!t.isLeaf()) t.resetMapping();
 		}
+		tree.mappingtree = NULL;
 		// establish LCA mapping
 		getLCA(tree.root, tree.root->parent(), speciestree->E, speciestree->R, speciestree->ri);
 	}
@@ -744,6 +1258,7 @@ public:
 			GeneNodeRooted &t = **itr;
 			if (!t.isLeaf()) t.resetMapping();
 		}
+		tree.mappingtree = NULL;
 		// establish LCA mapping (unrooted)
 		getLCA(tree.root, tree.root->parent(), speciestree->E, speciestree->R, speciestree->ri);
 		for (vector<NamedGeneNodeRooted*>::iterator itr=tree.leafnodes.begin(); itr!=tree.leafnodes.end(); itr++) {
@@ -757,6 +1272,7 @@ public:
 			GeneNodeUnrooted &t = **itr;
 			if (!t.isLeaf()) t.resetMapping();
 		}
+		tree.mappingtree = NULL;
 		// establish LCA mapping (unrooted)
 		getLCA(tree.root, tree.root->parent(), speciestree->E, speciestree->R, speciestree->ri);
 		for (vector<NamedGeneNodeUnrooted*>::iterator itr=tree.leafnodes.begin(); itr!=tree.leafnodes.end(); itr++) {
@@ -765,6 +1281,108 @@ public:
 		}
 	}
 
+	// ------------------------------------------------------------------------------------------------------
+	// incremental LCA mapping: the mappings of a gene tree that are not NULL stay valid for its species tree
+	// (mappingtree) while the species tree is only changed by moving subtrees; before a subtree is moved,
+	// discardMapping removes the mappings that may change and the update functions recompute only those
+	template<class GeneTree>
+	void keepMapping(GeneTree &tree) {
+		if ((tree.mappingtree == speciestree) && (tree.mappingversion == speciestree->version)) return;
+		for (typename vector<typename GeneTree::Node*>::iterator itr=tree.nodes.begin(); itr!=tree.nodes.end(); itr++) {
+			typename GeneTree::Node &t = **itr;
+			if (!t.isLeaf()) t.resetMapping();
+		}
+		tree.mappingtree = speciestree;
+		tree.mappingversion = speciestree->version;
+	}
+
+	// establish the missing LCA mappings of one gene tree (the same result as createPrimaryMapping)
+	void updatePrimaryMapping(GeneTreeRooted &tree) {
+		keepMapping(tree);
+		getLCA(tree.root, tree.root->parent(), speciestree->E, speciestree->R, speciestree->ri);
+	}
+	void updatePrimaryMapping(GeneTreeUnrooted &tree) {
+		keepMapping(tree);
+		// the root node is moved by rerooting, its mappings are always recomputed
+		tree.root->resetMapping();
+		getLCA(tree.root, tree.root->parent(), speciestree->E, speciestree->R, speciestree->ri);
+	}
+
+	// establish the missing LCA mappings of one unrooted gene tree (the same result as createPrimaryMappingUnrooted)
+	void updatePrimaryMappingUnrooted(GeneTreeUnrooted &tree) {
+		updatePrimaryMapping(tree);
+		for (vector<NamedGeneNodeUnrooted*>::iterator itr=tree.leafnodes.begin(); itr!=tree.leafnodes.end(); itr++) {
+			GeneNodeUnrooted *node = (GeneNodeUnrooted*)*itr;
+			getLCA(node->parent(), node, speciestree->E, speciestree->R, speciestree->ri);
+		}
+	}
+
+	// discard the LCA mappings onto the proper ancestors of a species node - the only mappings that change
+	// when the subtree of the node is moved (the order of the species tree has to be established)
+	inline bool isProperAncestor(SpeciesNode *mapping, SpeciesNode *node) {
+		return (mapping != NULL) && (mapping != node) && (mapping->begin <= node->begin) && (node->end <= mapping->end);
+	}
+	void discardMapping(GeneTreeRooted &tree, SpeciesNode *node) {
+		if (tree.mappingtree != speciestree) return;
+		for (vector<GeneNodeRooted*>::iterator itr=tree.nodes.begin(); itr!=tree.nodes.end(); itr++) {
+			GeneNodeRooted &t = **itr;
+			if (isProperAncestor(t.getMapping(), node)) t.resetMapping();
+		}
+	}
+	void discardMapping(GeneTreeUnrooted &tree, SpeciesNode *node) {
+		if (tree.mappingtree != speciestree) return;
+		for (vector<GeneNodeUnrooted*>::iterator itr=tree.nodes.begin(); itr!=tree.nodes.end(); itr++) {
+			GeneNodeUnrooted &t = **itr;
+			for (int i=0; i<3; i++) {
+				if (isProperAncestor(t.getMapping(i), node)) t.getMapping(i) = NULL;
+			}
+		}
+	}
+
+	// virtual pruning (see SpeciesTree::pruneVirtual): the mappings onto the proper ancestors of the pruned
+	// subtree are discarded like for a move but kept for restoreMapping; the mappings established while the
+	// subtree is pruned are the same for the unpruned tree except the ones onto the new root
+	vector<pair<SpeciesNode**, SpeciesNode*> > prunedmapping;
+	void pruneMapping(GeneTreeRooted &tree, SpeciesNode *node) {
+		if ((tree.mappingtree != speciestree) || (tree.mappingversion != speciestree->version)) return;
+		for (vector<GeneNodeRooted*>::iterator itr=tree.nodes.begin(); itr!=tree.nodes.end(); itr++) {
+			SpeciesNode *&mapping = (*itr)->getMapping();
+			if (!isProperAncestor(mapping, node)) continue;
+			prunedmapping.push_back(make_pair(&mapping, mapping));
+			mapping = NULL;
+		}
+	}
+	void pruneMapping(GeneTreeUnrooted &tree, SpeciesNode *node) {
+		if ((tree.mappingtree != speciestree) || (tree.mappingversion != speciestree->version)) return;
+		for (vector<GeneNodeUnrooted*>::iterator itr=tree.nodes.begin(); itr!=tree.nodes.end(); itr++) {
+			for (int i=0; i<3; i++) {
+				SpeciesNode *&mapping = (*itr)->getMapping(i);
+				if (!isProperAncestor(mapping, node)) continue;
+				prunedmapping.push_back(make_pair(&mapping, mapping));
+				mapping = NULL;
+			}
+		}
+	}
+	// (before the subtree is restored, the kept mappings are written back by restorePrunedMapping)
+	void restoreMapping(GeneTreeRooted &tree) {
+		if ((tree.mappingtree != speciestree) || (tree.mappingversion != speciestree->version)) return;
+		for (vector<GeneNodeRooted*>::iterator itr=tree.nodes.begin(); itr!=tree.nodes.end(); itr++) {
+			if ((*itr)->getMapping() == speciestree->root) (*itr)->resetMapping();
+		}
+	}
+	void restoreMapping(GeneTreeUnrooted &tree) {
+		if ((tree.mappingtree != speciestree) || (tree.mappingversion != speciestree->version)) return;
+		for (vector<GeneNodeUnrooted*>::iterator itr=tree.nodes.begin(); itr!=tree.nodes.end(); itr++) {
+			for (int i=0; i<3; i++) {
+				if ((*itr)->getMapping(i) == speciestree->root) (*itr)->getMapping(i) = NULL;
+			}
+		}
+	}
+	void restorePrunedMapping() {
+		for (int i=0, last=prunedmapping.size(); i<last; i++) *prunedmapping[i].first = prunedmapping[i].second;
+		prunedmapping.clear();
+	}
+
 	// returns the LCA mapping (if necessary establish LCA mapping)
 	SpeciesNode* &getLCA(GeneNodeRooted* &node, GeneNodeRooted* &node2, VAL E[], INT R[], struct rmqinfo *&ri) {
 		#ifdef DEBUG
@@ -815,18 +1433,20 @@ public:
 	void createSecondaryMapping(GeneTree &tree, SpeciesNode *&subtreeroot) {
 		// establish LCA mapping
 		if (tree.root->getMapping() == speciestree->root) {
-			get2ndLCA(tree.root, *subtreeroot, speciestree->E, speciestree->R, speciestree->ri);
+			get2ndLCA(tree.root, *subtreeroot, tree.secondaryepoch, speciestree->E, speciestree->R, speciestree->ri);
 		}
 	}
 
 	// returns the 2nd LCA mapping (if necessary establish mapping)
 	template<class GeneNode>
-	SpeciesNode* &get2ndLCA(GeneNode* &node, SpeciesNode &subtreeroot, VAL E[], INT R[], struct rmqinfo *&ri) {
+	SpeciesNode* &get2ndLCA(GeneNode* &node, SpeciesNode &subtreeroot, const unsigned int epoch, VAL E[], INT R[], struct rmqinfo *&ri) {
 		#ifdef DEBUG
 		if (node == NULL) EXCEPTION("node is NULL in get2ndLCA" << endl);
 		#endif
 		SpeciesNode *&mapping2 = node->secondarymapping;
-		if (mapping2 != NULL) return mapping2;
+		if (node->secondarystamp == epoch) return mapping2;
+		node->secondarystamp = epoch;
+		mapping2 = NULL;
 
 		SpeciesNode *&mapping1 = node->getMapping();
 		if (mapping1 != speciestree->root) {
@@ -847,8 +1467,8 @@ public:
 				}
 			}
 			#endif
-			SpeciesNode *&u = get2ndLCA(node->child(0), subtreeroot, E, R, ri);
-			SpeciesNode *&v = get2ndLCA(node->child(1), subtreeroot, E, R, ri);
+			SpeciesNode *&u = get2ndLCA(node->child(0), subtreeroot, epoch, E, R, ri);
+			SpeciesNode *&v = get2ndLCA(node->child(1), subtreeroot, epoch, E, R, ri);
 			if (u == NULL) mapping2 = v;
 			else
 			if (v == NULL) mapping2 = u;
@@ -867,20 +1487,20 @@ public:
 	inline void addSupportNode(GeneNodeUnrooted* &node) {
 		supportnode_unrooted.push_back(node);
 	}
+	// (a new epoch of the gene tree, the nodes are only visited again if the epoch wraps around)
 	inline void removeSecondaryMapping(GeneTreeRooted &tree) {
-		resetSecondaryMappingDFS(tree.root);
+		resetSecondaryMapping(tree);
 		supportnode_rooted.clear();
 	}
 	inline void removeSecondaryMapping(GeneTreeUnrooted &tree) {
-		resetSecondaryMappingDFS(tree.root);
+		resetSecondaryMapping(tree);
 		supportnode_unrooted.clear();
 	}
-	template<class GeneNode>
-	inline void resetSecondaryMappingDFS(GeneNode *&node) {
-		if ((node == NULL) || (node->secondarymapping == NULL)) return;
-		node->secondarymapping = NULL;
-		resetSecondaryMappingDFS(node->child(0));
-		resetSecondaryMappingDFS(node->child(1));
+	template<class GeneTree>
+	inline void resetSecondaryMapping(GeneTree &tree) {
+		if (++tree.secondaryepoch != 0) return;
+		for (int i=0, last=tree.nodes.size(); i<last; i++) tree.nodes[i]->secondarystamp = 0;
+		tree.secondaryepoch = 1;
 	}
 
 	// ------------------------------------------------------------------------------------------------------
@@ -891,12 +1511,14 @@ public:
 	}
 
 	inline void computeGeneDuplicationsTripleAdd() {
+		const unsigned int epoch = speciestree->tripleepoch;
 		for (vector<GeneNodeRooted*>::iterator itr=supportnode_rooted.begin(); itr!=supportnode_rooted.end(); itr++) {
 			GeneNodeRooted &node = **itr;
 			GeneNodeRooted &parent = *node.parent();
 			GeneNodeRooted &sibling = *node.getSibling();
 			if (!sibling.belongs2GammaTree()) {
 				// both nodes are in the ghost-node-tree
+				node.secondarymapping->touchTriple(epoch);
 				node.secondarymapping->gain++;
 			} else {
 				// only one node is in the ghost-node-tree
@@ -904,9 +1526,11 @@ public:
 				const int vmapid = sibling.secondarymapping->no;
 				const int omapid = node.secondarymapping->no;
 				if ((vmapid < umapid) && (umapid < omapid)) {
+					parent.secondarymapping->touchTriple(epoch);
 					parent.secondarymapping->lost[0]++;
 				} else
 				if ((omapid < umapid) && (umapid < vmapid)) {
+					parent.secondarymapping->touchTriple(epoch);
 					parent.secondarymapping->lost[1]++;
 				}
 			}
@@ -917,6 +1541,7 @@ public:
 			GeneNodeUnrooted &sibling = *node.getSibling();
 			if (!sibling.belongs2GammaTree()) {
 				// both nodes are in the ghost-node-tree
+				node.secondarymapping->touchTriple(epoch);
 				node.secondarymapping->gain++;
 			} else {
 				// only one node is in the ghost-node-tree
@@ -924,9 +1549,11 @@ public:
 				const int vmapid = sibling.secondarymapping->no;
 				const int omapid = node.secondarymapping->no;
 				if ((vmapid < umapid) && (umapid < omapid)) {
+					parent.secondarymapping->touchTriple(epoch);
 					parent.secondarymapping->lost[0]++;
 				} else
 				if ((omapid < umapid) && (umapid < vmapid)) {
+					parent.secondarymapping->touchTriple(epoch);
 					parent.secondarymapping->lost[1]++;
 				}
 			}
@@ -37,14 +37,42 @@ public:
 		#ifdef DEBUG
 		cout << "Heuristic created" << endl;
 		#endif
+		random = NULL;
+		greedy = false;
+		numthreads = 0;
+		threadpool = NULL;
+		pass = 0;
 	}
 
 	virtual ~HeuristicLeafAdd() {
+		for (int i=0; i<workers.size(); i++) delete workers[i];
+		delete threadpool;
 		#ifdef DEBUG
 		cout << "Heuristic destroyed" << endl;
 		#endif
 	}
 
+	// ------------------------------------------------------------------------------------------------------
+	// greedy leaf adding: every step scores all remaining leaves and inserts the best one
+	// (with threads the leaves are scored concurrently, see buildtree-leafadd-parallel.h)
+	bool greedy;
+	int numthreads;
+	ThreadPool *threadpool;
+	vector<HeuristicLeafAdd*> workers;
+	unsigned int pass; // number of the current scoring step
+
+	// greedy mode scored by n threads (0 = single-threaded)
+	void setGreedy(const bool greedy, const int n = 0) {
+		this->greedy = greedy;
+		numthreads = n;
+	}
+
+	// random number generator of the search (owned by the caller)
+	Random *random;
+	void setRandom(Random *random) {
+		this->random = random;
+	}
+
 	// ------------------------------------------------------------------------------------------------------
 	// compute the gene duplications
 	inline void computeGeneDuplications(SpeciesNode *subtree, bool reroot = true) {
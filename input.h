@@ -35,6 +35,7 @@ public:
 	int prevcolumn, column;
 	stack<char> st;
 	bool skipComments;
+	Random *random; // resolves multifurcations of the trees read (NULL = the first children are joined)
 
 	Input(istream *in = NULL, int line = 1, int column = 1) : in(in) {
 		this->line = line;
@@ -42,6 +43,7 @@ public:
 		this->column = column;
 		prevcolumn = column;
 		skipComments = true;
+		random = NULL;
 		callbackflag = false;
 		commentcallback == NULL;
 	}
@@ -0,0 +1,284 @@
+/*
+Copyright (C) 2024 Mukul S. Bansal (mukul.bansal@uconn.edu).
+Based on open-source code originally written by Andre Wehe and
+Mukul S. Bansal for the DupTree software package.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MULTIRUN_H
+#define MULTIRUN_H
+
+#include <chrono>
+
+// ------------------------------------------------------------------------------------------------------------------
+// output the gene trees of a search in the rooting it has chosen
+void writeGeneTrees(ostream &os, gtpspr::Heuristic &heuristic) {
+	// with worker processes the coordinator holds no gene trees
+	if (!heuristic.shardgenetrees.empty()) {
+		os << heuristic.shardgenetrees;
+		return;
+	}
+	for (int i = 0, last = heuristic.genetree_rooted.size(); i < last; i++) {
+		heuristic.genetree_rooted.at(i)->tree2newick(os); os << endl;
+	}
+	for (int i = 0, last = heuristic.genetree_unrooted.size(); i < last; i++) {
+		os << "[&U]"; heuristic.genetree_unrooted.at(i)->tree2newick(os); os << endl;
+	}
+}
+
+// ------------------------------------------------------------------------------------------------------------------
+// result of one run of a multi-start search
+struct RunResult {
+	unsigned int seed;
+	double score;
+	unsigned int moves; // number of rSPR tree edit operations
+	double seconds; // wall time
+	double rootseconds; // wall time of the gene tree rooting passes
+	string speciestree, genetrees; // newick (gene trees in the rooting chosen by the run)
+	vector<double> trajectory; // score after every round of the local search
+	vector<int> migrated; // entries of the trajectory where an island took over the best tree of the board
+};
+
+// ------------------------------------------------------------------------------------------------------------------
+// the best species tree published by the islands of an island search
+class MigrationBoard {
+public:
+	mutex lock;
+	double score;
+	gtpspr::SpeciesTree *tree; // private copy of the published species tree
+	int island; // island that published it (-1 = none yet)
+
+	MigrationBoard() {
+		score = UINT_MAX;
+		tree = NULL;
+		island = -1;
+	}
+
+	~MigrationBoard() {
+		delete tree;
+	}
+
+	// publish a species tree if it is better than the one on the board
+	void publish(gtpspr::SpeciesTree &src, const double srcscore, const int srcisland) {
+		lock_guard<mutex> guard(lock);
+		if (srcscore >= score) return;
+		src.assignIndex();
+		delete tree;
+		tree = new gtpspr::SpeciesTree;
+		tree->replicate(src);
+		score = srcscore;
+		island = srcisland;
+	}
+
+	// take over the species tree of the board if it is better than 'dstscore' (dstscore becomes its score)
+	bool adopt(gtpspr::SpeciesTree &dst, double &dstscore) {
+		lock_guard<mutex> guard(lock);
+		if ((tree == NULL) || (score >= dstscore)) return false;
+		dst.adoptTopology(*tree);
+		dstscore = score;
+		return true;
+	}
+};
+
+// ------------------------------------------------------------------------------------------------------------------
+// rSPR local search that shares its progress with other islands through a migration board
+// after every round it publishes its species tree when that beats the board; only when it is stuck it
+// continues from the tree of the board if that is better than its own, so the islands search apart until then
+class Island : public gtpspr::SimpleHeuristicRandom {
+public:
+	MigrationBoard *board; // NULL = independent run
+	int island;
+	vector<double> trajectory;
+	vector<int> migrated;
+
+	Island(Format format, bool score_flag, MigrationBoard *board, const int island) :
+		SimpleHeuristicRandom(format, score_flag), board(board), island(island) {}
+
+	bool migrate(const bool stuck) {
+		if (!stuck) {
+			trajectory.push_back(Best_score);
+			if (board != NULL) board->publish(*speciestree, Best_score, island);
+			return false;
+		}
+		if ((board == NULL) || !board->adopt(*speciestree, Best_score)) return false;
+		migrated.push_back(trajectory.size());
+		trajectory.push_back(Best_score);
+		return true;
+	}
+};
+
+// ------------------------------------------------------------------------------------------------------------------
+// independent searches (initial species tree + rSPR local search) with different seeds
+// the input is parsed only once into master tree sets and every run works on copies of their trees
+// task i = run i
+class MultiRun : public ThreadTask {
+public:
+	buildtree::HeuristicLeafAdd *leafadd; // gene trees and constraints for the leaf adding heuristic (NULL = generator 0)
+	gtpspr::TreeSet *master; // gene trees for the search (and the initial species tree for generator 0)
+	ReRoot reroot;
+	Format format;
+	bool score_flag;
+	vector<RunResult> results;
+	mutex lock;
+	bool verbose; // one line per finished run (the progress output of the runs themselves is turned off)
+	MigrationBoard *board; // island search (NULL = independent runs)
+	int sprradius; // regraft radius of the searches (0 = all positions)
+	int firstimprove; // first-improvement rounds of the searches (0 = off)
+	Engine engine; // scoring engine of the searches
+	RootSchedule rootschedule; // rooting schedule of the searches
+	int rootevery;
+
+	MultiRun(buildtree::HeuristicLeafAdd *leafadd, gtpspr::TreeSet *master, const ReRoot reroot, const Format format, const bool score_flag) :
+		leafadd(leafadd), master(master), reroot(reroot), format(format), score_flag(score_flag) {
+		if (master->speciestree != NULL) master->speciestree->assignIndex();
+		board = NULL;
+		sprradius = 0;
+		firstimprove = 0;
+		engine = TREES;
+		rootschedule = ROOT_EACH;
+		rootevery = 1;
+	}
+
+	~MultiRun() {
+		delete board;
+	}
+
+	// let the runs exchange their best species tree (island model)
+	void setIslands() {
+		delete board;
+		board = new MigrationBoard;
+	}
+
+	// limit the regraft positions of the searches (see Heuristic::setRadius)
+	void setRadius(const int k) {
+		sprradius = k;
+	}
+
+	// first-improvement rounds of the searches (see Heuristic::setFirstImprovement)
+	void setFirstImprovement(const int k) {
+		firstimprove = k;
+	}
+
+	// scoring engine of the searches (see Heuristic::setEngine)
+	void setEngine(const Engine e) {
+		engine = e;
+	}
+
+	// rooting schedule of the searches (see Heuristic::setRootSchedule)
+	void setRootSchedule(const RootSchedule s, const int k) {
+		rootschedule = s;
+		rootevery = k;
+	}
+
+	// run n searches with the given number of threads; run i uses the seed firstseed + i
+	// (islands always get a thread each, they have to run at the same time to exchange trees)
+	void run(const int n, const int numthreads, const unsigned int firstseed) {
+		results.resize(n);
+		for (int i=0; i<n; i++) results[i].seed = firstseed + i;
+		verbose = !quiet;
+		quiet = true;
+		ThreadPool pool(board != NULL ? n : (numthreads < 1 ? 1 : numthreads));
+		pool.run(*this, n);
+		quiet = !verbose;
+	}
+
+	void process(const int task, const int) {
+		RunResult &result = results[task];
+		const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		Random random(result.seed); // the run draws from its own generator, independent of the other runs
+
+		Island search(format, score_flag, board, task);
+		search.setRandom(&random);
+		search.setRadius(sprradius);
+		search.setFirstImprovement(firstimprove);
+		search.setEngine(engine);
+		search.setRootSchedule(rootschedule, rootevery);
+		if (leafadd != NULL) {
+			// build the initial species tree
+			ostringstream os;
+			{
+				buildtree::HeuristicSecondFast heuristic;
+				heuristic.copyTrees(*leafadd);
+				heuristic.setGreedy(leafadd->greedy);
+				heuristic.setRandom(&random);
+				heuristic.run(os, OPT);
+			}
+			istringstream is(os.str());
+			Input input(&is);
+			input.random = &random;
+			search.readSpeciesTree(input);
+		} else {
+			search.speciestree = new gtpspr::SpeciesTree;
+			search.speciestree->replicate(*master->speciestree);
+		}
+		search.copyGeneTrees(*master);
+
+		// local search
+		ostringstream ostreamSpeciesTree, ostreamGeneTrees;
+		search.run(ostreamSpeciesTree, reroot);
+		writeGeneTrees(ostreamGeneTrees, search);
+		result.score = search.getCurrentScore();
+		result.moves = search.getMoveCount();
+		result.speciestree = ostreamSpeciesTree.str();
+		result.genetrees = ostreamGeneTrees.str();
+		result.trajectory = search.trajectory;
+		result.migrated = search.migrated;
+		result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		result.rootseconds = search.roottime;
+
+		lock_guard<mutex> guard(lock);
+		if (verbose) cout << "Run " << task+1 << " (seed " << result.seed << "): weighted reconciliation cost " << result.score
+		       << ", " << result.moves << " rSPR operations, " << result.seconds << "s" << endl;
+	}
+
+	// the run with the lowest score (the first one of equal runs)
+	int best() {
+		int b = 0;
+		for (int i=1, last=results.size(); i<last; i++) {
+			if (results[i].score < results[b].score) b = i;
+		}
+		return b;
+	}
+
+	// output a table of all runs as comments
+	void writeTable(ostream &os) {
+		os << "[Runs: " << results.size() << ", best run: " << best()+1 << "]" << endl;
+		os << "[Run\tSeed\tScore\trSPR\tTime(s)\tRooting(s)]" << endl;
+		for (int i=0, last=results.size(); i<last; i++) {
+			RunResult &r = results[i];
+			os << "[" << i+1 << "\t" << r.seed << "\t" << r.score << "\t" << r.moves << "\t" << r.seconds << "\t" << r.rootseconds << "]" << endl;
+		}
+		if (board == NULL) return;
+
+		// score trajectories of the islands (* = continued from the best tree of the board)
+		os << "[Score after every round, * = tree taken over from the best island]" << endl;
+		for (int i=0, last=results.size(); i<last; i++) {
+			RunResult &r = results[i];
+			os << "[Island " << i+1 << ":";
+			const int migrations = r.migrated.size();
+			for (int k=0, m=0, rounds=r.trajectory.size(); k<rounds; k++) {
+				os << " ";
+				if ((m < migrations) && (r.migrated[m] == k)) {
+					os << "*";
+					m++;
+				}
+				os << r.trajectory[k];
+			}
+			os << "]" << endl;
+		}
+	}
+};
+
+#endif
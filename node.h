@@ -225,13 +225,16 @@ ostream & operator << (ostream & os, TreeNodeUnrooted<T> & m) {
 // ------------------------------------------------------------------------------------------------------------------
 // contains the ID (name) of a node
 // nodes with the same name are automatically grouped together
+// (the name list is shared by all trees, so it is locked for concurrent searches)
 class NodeID {
 public:
 	static map<string,int> namelist;
+	static mutex namelistlock;
 	map<string,int>::iterator name;
 
 	// create a node (with a given parent)
 	NodeID(const string &id) {
+		lock_guard<mutex> guard(namelistlock);
 		name = namelist.find(id);
 		if (name == namelist.end()) { // name doesn't exist
 			namelist[id] = 0;
@@ -242,6 +245,7 @@ public:
 
 	// destroy a node
 	virtual ~NodeID() {
+		lock_guard<mutex> guard(namelistlock);
 		name->second--;
 		if (name->second == 0) namelist.erase(name);
 	}
@@ -254,6 +258,7 @@ public:
 	friend ostream & operator << (ostream & os, NodeID & m);
 };
 map<string,int> NodeID::namelist;
+mutex NodeID::namelistlock;
 
 // output NodeID into a string stream
 ostream & operator << (ostream & os, NodeID & m) {
@@ -0,0 +1,79 @@
+/*
+Copyright (C) 2024 Mukul S. Bansal (mukul.bansal@uconn.edu).
+Based on open-source code originally written by Andre Wehe and
+Mukul S. Bansal for the DupTree software package.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <stdint.h>
+
+// largest number returned by Random::next()
+#define RANDOM_MAX 2147483647
+
+// ------------------------------------------------------------------------------------------------------------------
+// pseudo random number generator with its own state (every search owns one, so searches running at the
+// same time do not share any state); it produces the same numbers as rand() of the GNU C library after
+// srand() with the same seed, so a seed gives the same species trees as in earlier versions
+class Random {
+public:
+	Random(const unsigned int seed = 1) {
+		setSeed(seed);
+	}
+
+	void setSeed(unsigned int seed) {
+		if (seed == 0) seed = 1;
+		int32_t word = seed;
+		r[0] = word;
+		for (int i=1; i<31; i++) {
+			// 16807 * word % 2147483647 without overflow
+			const int32_t hi = word / 127773;
+			const int32_t lo = word % 127773;
+			word = 16807 * lo - 2836 * hi;
+			if (word < 0) word += 2147483647;
+			r[i] = word;
+		}
+		for (int i=31; i<34; i++) r[i] = r[i-31];
+		pos = 0;
+		for (int i=34; i<344; i++) next();
+	}
+
+	// next number in [0, RANDOM_MAX]
+	int next() {
+		// r[i] = r[i-31] + r[i-3] on a ring of the last 34 numbers
+		const uint32_t value = r[(pos+3) % 34] + r[(pos+31) % 34];
+		r[pos] = value;
+		pos = (pos + 1) % 34;
+		return value >> 1;
+	}
+
+	// number in [0, n)
+	int below(const int n) {
+		return next() % n;
+	}
+
+	// number in [0, 1)
+	double uniform() {
+		return next() / (RANDOM_MAX + 1.0);
+	}
+
+private:
+	uint32_t r[34];
+	int pos; // position of the oldest number in r
+};
+
+#endif
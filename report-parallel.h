@@ -0,0 +1,144 @@
+/*
+Copyright (C) 2024 Mukul S. Bansal (mukul.bansal@uconn.edu).
+Based on open-source code originally written by Andre Wehe and
+Mukul S. Bansal for the DupTree software package.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef REPORT_PARALLEL_H
+#define REPORT_PARALLEL_H
+
+// ------------------------------------------------------------------------------------------------------------------
+// scores gene trees of a master report on a private replica of the species tree
+class ReportWorker : public Report {
+public:
+	Report *master;
+
+	ReportWorker(Report *master) : master(master) {
+		speciestree = new SpeciesTree;
+		speciestree->replicate(*master->speciestree);
+		speciestree->establishOrder();
+		speciestree->preprocessLCA();
+	}
+
+	virtual ~ReportWorker() {
+		speciestree->postprocessLCA();
+	}
+
+	// score gene tree t of the master (rooted trees are numbered before unrooted trees)
+	void scoreTree(const int t, const bool reroot) {
+		const int rooted = master->genetree_rooted.size();
+		if (t < rooted) {
+			GeneTreeRooted &tree = *master->genetree_rooted[t];
+			mapLeaves(tree, speciestree);
+			computeGeneDuplicationsTree(tree);
+		} else {
+			GeneTreeUnrooted &tree = *master->genetree_unrooted[t - rooted];
+			mapLeaves(tree, speciestree);
+			computeGeneDuplicationsTree(tree, reroot);
+		}
+	}
+};
+
+// ------------------------------------------------------------------------------------------------------------------
+// scoring of all gene trees of a report (task i = gene tree i)
+class ReportScoringTask : public ThreadTask {
+public:
+	vector<ReportWorker*> &workers;
+	bool reroot;
+
+	ReportScoringTask(vector<ReportWorker*> &workers, const bool reroot) : workers(workers), reroot(reroot) {}
+
+	void process(const int task, const int worker) {
+		workers[worker]->scoreTree(task, reroot);
+	}
+};
+
+// ------------------------------------------------------------------------------------------------------------------
+// score all gene trees with a thread pool (every tree keeps its own score, so the result is the same as serially)
+void Report::computeGeneDuplicationsParallel(bool reroot) {
+	speciestree->assignIndex();
+	ThreadPool pool(numthreads);
+	vector<ReportWorker*> workers;
+	for (int i=0; i<pool.size(); i++) workers.push_back(new ReportWorker(this));
+
+	// the most expensive trees first (unrooted trees also take a pass over all rootings, see Rootings)
+	const double n = speciestree->nodes.size();
+	const int rooted = genetree_rooted.size();
+	multimap<double, int, greater<double> > sorted;
+	for (int t=0; t<rooted; t++) sorted.insert(pair<double, int>(genetree_rooted[t]->nodes.size() + n, t));
+	for (int t=0, last=genetree_unrooted.size(); t<last; t++) {
+		const double m = genetree_unrooted[t]->nodes.size();
+		sorted.insert(pair<double, int>(reroot ? 2 * (m + n) : m + n, rooted + t));
+	}
+	vector<int> order;
+	for (multimap<double, int, greater<double> >::iterator itr=sorted.begin(); itr!=sorted.end(); itr++) order.push_back(itr->second);
+
+	ReportScoringTask task(workers, reroot);
+	pool.run(task, order);
+
+	// the leaf mappings have to point into the species tree of the report again (before the replicas are gone)
+	for (int i=0, last=genetree_rooted.size(); i<last; i++) mapLeaves(*genetree_rooted[i], speciestree);
+	for (int i=0, last=genetree_unrooted.size(); i<last; i++) mapLeaves(*genetree_unrooted[i], speciestree);
+	for (int i=0, last=workers.size(); i<last; i++) delete workers[i];
+}
+
+// ------------------------------------------------------------------------------------------------------------------
+// reports for several species trees with the same gene trees (task i = species tree i)
+// with a single species tree the threads score its gene trees instead
+class ReportSet : public ThreadTask {
+public:
+	vector<string> &speciestrees; // newick, one species tree per entry
+	const string &genetrees; // newick of all gene trees
+	bool genetreesFlag, score_flag;
+	Format format;
+	int numthreads;
+	vector<string> reports;
+
+	ReportSet(vector<string> &speciestrees, const string &genetrees, const bool genetreesFlag, const bool score_flag, const Format format) :
+		speciestrees(speciestrees), genetrees(genetrees), genetreesFlag(genetreesFlag), score_flag(score_flag), format(format) {
+		numthreads = 0;
+	}
+
+	// create all reports with n threads (0 = single-threaded)
+	void run(const int n) {
+		numthreads = n;
+		reports.resize(speciestrees.size());
+		if (speciestrees.size() == 1) {
+			process(0, 0);
+			return;
+		}
+		ThreadPool pool(n < 1 ? 1 : n);
+		pool.run(*this, speciestrees.size());
+	}
+
+	void process(const int task, const int) {
+		istringstream istreamReport(speciestrees[task] + genetrees);
+		Input inputReport(&istreamReport);
+
+		Report report;
+		if (speciestrees.size() == 1) report.setThreads(numthreads);
+
+		// read input trees
+		report.readTrees(inputReport);
+
+		// create record
+		ostringstream os;
+		report.createReportInComment(os, true, task+1, genetreesFlag, score_flag, format);
+		reports[task] = os.str();
+	}
+};
+
+#endif
@@ -304,6 +304,9 @@ class GeneNodeUnrooted : public TreeNodeUnrooted<GeneNodeUnrooted>, public Prima
 public:
 	using PrimaryMappingUnrooted<SpeciesNode>::getMapping;
 
+	// duplications and losses of the subtree seen from direction i (for all rootings, -1 = not computed yet)
+	int rootingdup[3], rootingloss[3];
+
 	GeneNodeUnrooted(GeneNodeUnrooted *parent = NULL) : TreeNodeUnrooted<GeneNodeUnrooted>(parent) {}
 
 	// get LCA mapping in rooted direction
@@ -396,6 +399,29 @@ public:
 		for (int i = 0; i < nodes.size(); i++) nodes[i]->idx = i;
 	}
 
+	// create a copy of another species tree (node i is the copy of node i in src; the indices of src have to be assigned)
+	void replicate(SpeciesTree &src) {
+		for (int i = 0; i < src.nodes.size(); i++) {
+			SpeciesNode *node = src.nodes[i];
+			SpeciesNode *copy;
+			if (node->isLeaf()) {
+				NamedSpeciesNode *leaf = new NamedSpeciesNode(((NamedSpeciesNode*)node)->getName());
+				leafnodes.push_back(leaf);
+				copy = leaf;
+			} else copy = new SpeciesNode();
+			copy->idx = i;
+			nodes.push_back(copy);
+		}
+		for (int i = 0; i < src.nodes.size(); i++) {
+			SpeciesNode *node = src.nodes[i];
+			SpeciesNode *copy = nodes[i];
+			copy->parent() = node->parent() == NULL ? NULL : nodes[node->parent()->idx];
+			for (int j = 0; j < 2; j++)
+				copy->child(j) = node->child(j) == NULL ? NULL : nodes[node->child(j)->idx];
+		}
+		root = nodes[src.root->idx];
+	}
+
 	// node numbering + range of subtree
 	inline void establishOrder() {
 		int pos = 0;
@@ -533,6 +559,15 @@ public:
 		#endif
 	}
 
+	// redirect the leaf mappings of a gene tree to the nodes with the same index in another species tree
+	template<class GeneTree>
+	void mapLeaves(GeneTree &tree, SpeciesTree *target) {
+		for (int i=0, last=tree.leafnodes.size(); i<last; i++) {
+			SpeciesNode *node = target->nodes[tree.leafnodes[i]->getMapping()->idx];
+			tree.leafnodes[i]->setMapping(node);
+		}
+	}
+
 	// ------------------------------------------------------------------------------------------------------
 	// read all trees from the input
 	void readTrees(Input &input) {
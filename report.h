@@ -28,6 +28,8 @@ public:
 		#ifdef DEBUG
 		cout << "Report created" << endl;
 		#endif
+		numthreads = 0;
+		fullrelevant = false;
 	}
 
 	virtual ~Report() {
@@ -39,94 +41,82 @@ public:
 	// ------------------------------------------------------------------------------------------------------
 	// compute the gene duplications
 	inline void computeGeneDuplications(bool reroot = true) {
+		if ((numthreads > 0) && (genetree_rooted.size() + genetree_unrooted.size() > 1)) {
+			computeGeneDuplicationsParallel(reroot);
+			return;
+		}
 		speciestree->establishOrder();
 		speciestree->preprocessLCA();
 //		resetLossStuff(speciestree->root);
 		// process all rooted trees
 		for(int i=0; i<genetree_rooted.size(); i++) {
-			GeneTreeRooted &tree = *genetree_rooted[i];
-			createPrimaryMapping(tree);
-			unsigned int &score = tree.score;
-			score = getScore(tree);
-
-			resetRelevantTree(speciestree->root);
-			buildRelevantTree(tree);
-			unsigned int &lossScore = tree.lossScore;
-			lossScore  = computeGeneLossForRoot(tree);
-			
+			computeGeneDuplicationsTree(*genetree_rooted[i]);
 		}
 		// process all unrooted trees
 		for(int i=0; i<genetree_unrooted.size(); i++) {
-			GeneTreeUnrooted &tree = *genetree_unrooted[i];
-			if (reroot) { // find the best geneduplication score of all rootings (rerooting of the genetrees)
-				createPrimaryMappingUnrooted(tree);
-				unsigned int &score = tree.score;
-				score = getScore(tree);
-				resetRelevantTree(speciestree->root);
-				buildRelevantTree(tree);
-				unsigned int &lossScore = tree.lossScore;
-				lossScore  = computeGeneLossForRoot(tree);
-		
-				GeneNodeUnrooted *u = tree.root->child(0);
-				GeneNodeUnrooted *v = tree.root->child(1);
-				best_node[0] = u;
-				best_node[1] = v;
-				#ifdef DEBUG
-				position_counter_debug = 2;
-				if ((u == NULL) || (v == NULL)) EXCEPTION("child = NULL in computeGeneDuplications" << endl);
-				#endif
-				moveRoot(tree, u, score, lossScore);
-				moveRoot(tree, v, score, lossScore);
-				#ifdef DEBUG
-				if (position_counter_debug != tree.nodes.size()-1)
-					WARNING("tree traversal failed in computeGeneDuplications" << position_counter_debug << " != " << tree.nodes.size()-1 << endl);
-				#endif
-				tree.reroot(best_node[0], best_node[1]);
-			} else { // find the best genedupication of the current rooting
-				createPrimaryMapping(tree);
-				unsigned int &score = tree.score;
-				score = getScore(tree);
-				
-				resetRelevantTree(speciestree->root);
-				buildRelevantTree(tree);
-				unsigned int &lossScore = tree.lossScore;
-				lossScore  = computeGeneLossForRoot(tree);
-			}
+			computeGeneDuplicationsTree(*genetree_unrooted[i], reroot);
 		}
 		speciestree->postprocessLCA();
 	}
 
-	// calculate the gene duplication for all rootings
-	#ifdef DEBUG
-	int position_counter_debug;
-	#endif
-	GeneNodeUnrooted *best_node[2];
-	inline void moveRoot(GeneTreeUnrooted &tree, GeneNodeUnrooted *p, unsigned int &best_score1, unsigned int &best_score2) {
-		GeneNodeUnrooted *c[2];
-		for (int i=0; i<2; i++) c[i] = p->child(i);
-		for (int i=0; i<2; i++) {
-			if (c[i] != NULL) {
-				moveRoot(tree, c[i], best_score1, best_score2);
-				tree.reroot(c[i], p);
-				#ifdef DEBUG
-				tree.checkStructure();
-				position_counter_debug++;
-				#endif
-				const int score = getScore(tree);
-				resetRelevantTree(speciestree->root);
-				buildRelevantTree(tree);
-				const int lossScore  = computeGeneLossForRoot(tree);
-				
-				if ((score + lossScore) < (best_score1 + best_score2)) {
-					best_score1 = score; 
-					best_score2 = lossScore;
-					best_node[1] = c[i];
-					best_node[0] = p;
-				}
-			}
+	// compute the gene duplications and losses of one gene tree (the LCA lookup table has to be ready)
+	inline void computeGeneDuplicationsTree(GeneTreeRooted &tree) {
+		createPrimaryMapping(tree);
+		unsigned int &score = tree.score;
+		score = getScore(tree);
+
+		prepareRelevantTree(tree);
+		unsigned int &lossScore = tree.lossScore;
+		lossScore  = computeGeneLossForRoot(tree);
+	}
+	inline void computeGeneDuplicationsTree(GeneTreeUnrooted &tree, bool reroot) {
+		if (reroot) { // find the best geneduplication score of all rootings (rerooting of the genetrees)
+			createPrimaryMappingUnrooted(tree);
+			prepareRelevantTree(tree);
+			GeneNodeUnrooted *best[2];
+			int lossScore;
+			Rootings<GeneTreeUnrooted, SpeciesNode>::findBest(tree, 1, best, tree.score, lossScore);
+			tree.lossScore = lossScore;
+			tree.reroot(best[0], best[1]);
+		} else { // find the best genedupication of the current rooting
+			createPrimaryMapping(tree);
+			unsigned int &score = tree.score;
+			score = getScore(tree);
+			
+			prepareRelevantTree(tree);
+			unsigned int &lossScore = tree.lossScore;
+			lossScore  = computeGeneLossForRoot(tree);
 		}
 	}
+
+	// ------------------------------------------------------------------------------------------------------
+	// multi-threaded scoring of the gene trees (see report-parallel.h)
+	int numthreads;
+
+	// score the gene trees with n threads (0 = single-threaded)
+	void setThreads(const int n) {
+		numthreads = n;
+	}
+	void computeGeneDuplicationsParallel(bool reroot);
 	
+	// relevant tree of a gene tree (with unlimited losses it is the whole species tree for all gene trees and
+	// its depths are computed once)
+	bool fullrelevant;
+	template<class GeneTree>
+	inline void prepareRelevantTree(GeneTree &tree) {
+		if (!LIMIT_LOSSES) {
+			if (fullrelevant) return;
+			resetRelevantTree(speciestree->root);
+			doPostOrder(speciestree->root);
+			doSecondPostOrder(speciestree->root);
+			doPreOrder(speciestree->root, 1);
+			fullrelevant = true;
+			return;
+		}
+		resetRelevantTree(speciestree->root);
+		buildRelevantTree(tree);
+	}
+
 	// Reset the subtreeSize counter at each node to 0, reset the isRelevant flag to false and and set nodeDepth to 0
 	void resetRelevantTree(SpeciesNode *node){
 		if (node->child(0) != NULL) {
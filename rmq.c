@@ -80,17 +80,45 @@ INT rm_query_naive(VAL * a, INT x, INT y){
  */
 struct rmqinfo * rm_query_preprocess(VAL * array, INT alen){
   struct rmqinfo * info;
+  INT j, rows, cols, block_cnt, rowelmlen;
+
+  info = (struct rmqinfo *) malloc(sizeof(struct rmqinfo));
+  block_cnt = ((alen-1) >> 5) + 1;
+  info->block_min = (INT *) malloc (sizeof(INT) * block_cnt);
+  rows = intlog2(block_cnt);
+  info->sparse = NULL;
+  if(rows > 0){
+    info->sparse = (INT **) malloc (sizeof(INT *) * rows);
+    info->sparse[0] = (INT *) malloc (sizeof(INT) * (block_cnt - 1));
+    for(j = 1; j < rows; j++){
+      rowelmlen = 2 << j;    /* 2^{j+1} */
+      cols = block_cnt - rowelmlen + 1;
+      info->sparse[j] = (INT *) malloc (sizeof(INT) * cols);
+    }
+  }
+  info->labels = (INT *) malloc(sizeof(INT) * alen);
+  info->array = array;
+  info->alen = alen;
+  rm_query_refresh(info);
+  return info;
+}
+
+/*
+ * Redo the preprocessing after the values of the array have changed
+ * (same array and length), reusing the memory of the first preprocessing.
+ */
+void rm_query_refresh(struct rmqinfo * info){
+  VAL * array = info->array;
+  INT alen = info->alen;
   INT i, j, g, rows, cols, block_cnt, rowelmlen;
-  INT * block_min, **sparse, *labels;
+  INT * block_min = info->block_min, **sparse = info->sparse, *labels = info->labels;
   INT gstack[32], gstacksize = 0;
 
-  info = (struct rmqinfo *) malloc(sizeof(struct rmqinfo));
   /* divide input array into blocks of size 32.
    * block_cnt is the number of such blocks.
    * block_minpos is an array that contains the
    * minimum positions in each block. */
   block_cnt = ((alen-1) >> 5) + 1;
-  block_min = (INT *) malloc (sizeof(INT) * block_cnt);
   for(i = j = 0; i < alen; i++){
     if(i % 32 == 0){
       if(i > 0) j++;
@@ -103,13 +131,10 @@ struct rmqinfo * rm_query_preprocess(VAL * array, INT alen){
    * sparse[j][i] represents the minimum in
    * block[i] to block[i + 2^{j+1} - 1] */
   rows = intlog2(block_cnt);
-  sparse = NULL;
   /* sparse tables aren't needed when the array is less than 32 elements long */
   if(rows > 0){
-    sparse = (INT **) malloc (sizeof(INT *) * rows);
     /* first row is min of adjacent entries. Table entries are
      * converted to positions in original array */
-    sparse[0] = (INT *) malloc (sizeof(INT) * (block_cnt - 1));
     for(i = 0; i < block_cnt - 1; i++){
       if(VAL_LT(array[block_min[i+1]],array[block_min[i]]))
         sparse[0][i] = block_min[i+1];
@@ -119,7 +144,6 @@ struct rmqinfo * rm_query_preprocess(VAL * array, INT alen){
     for(j = 1; j < rows; j++){
       rowelmlen = 2 << j;    /* 2^{j+1} */
       cols = block_cnt - rowelmlen + 1;
-      sparse[j] = (INT *) malloc (sizeof(INT) * cols);
       for(i = 0; i < cols; i++){
         if(VAL_LT(array[sparse[j-1][i + (rowelmlen >> 1)]],array[sparse[j-1][i]]))
           sparse[j][i] = sparse[j-1][i + (rowelmlen >> 1)];
@@ -135,7 +159,6 @@ struct rmqinfo * rm_query_preprocess(VAL * array, INT alen){
    * where array[g[i]] < array[i] (or -1 if there is no such position).
    * - l[i]: the jth bit of l[i] is 1 iff j is the first
    * position left of i where array[j] < array[i] */
-  labels = (INT *) malloc(sizeof(INT) * alen);
   for(i = 0; i < alen; i++){
     if(i % 32 == 0) gstacksize = 0;
     labels[i] = 0;
@@ -148,12 +171,6 @@ struct rmqinfo * rm_query_preprocess(VAL * array, INT alen){
     }
     gstack[gstacksize++] = i;
   }
-  info->array = array;
-  info->sparse = sparse;
-  info->block_min = block_min;
-  info->labels = labels;
-  info->alen = alen;
-  return info;
 }
 
 
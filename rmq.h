@@ -59,6 +59,12 @@ INT rm_query_naive(VAL * a, INT x, INT y);
 struct rmqinfo * rm_query_preprocess(VAL * a, INT alen);
 
 
+/*
+ * Redo the preprocessing after the values of the array have changed
+ * (same array and length), reusing the memory of the first preprocessing.
+ */
+void rm_query_refresh(struct rmqinfo * info);
+
 /*
  * Return the position in array which gives the minimum value
  * in the subarray rmqinfo.array[x..y] using preprocessed information.
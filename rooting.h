@@ -0,0 +1,149 @@
+/*
+Copyright (C) 2024 Mukul S. Bansal (mukul.bansal@uconn.edu).
+Based on open-source code originally written by Andre Wehe and
+Mukul S. Bansal for the DupTree software package.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ROOTING_H
+#define ROOTING_H
+
+// ------------------------------------------------------------------------------------------------------------------
+// duplication and loss cost of all rootings of an unrooted gene tree in time linear in the size of the gene tree
+// (used by the rSPR search and the report)
+// the cost of the subtree of a node seen from one of its neighbours only depends on the directed LCA mappings,
+// so it is computed once for every direction of every edge (gene node fields rootingdup/rootingloss) and shared
+// by all rootings; the unrooted LCA mappings and the node depths of the relevant species tree have to be ready
+template<class GeneTree, class SpeciesNode>
+class Rootings {
+public:
+	typedef typename GeneTree::Node GeneNode;
+
+	// forget the subtree costs (after the LCA mappings or the relevant tree have changed)
+	static void reset(GeneTree &tree) {
+		for (typename vector<GeneNode*>::iterator itr=tree.nodes.begin(); itr!=tree.nodes.end(); itr++) {
+			GeneNode &t = **itr;
+			for (int i=0; i<3; i++) t.rootingdup[i] = -1;
+		}
+	}
+
+	// cost of the current rooting (the same as the duplication and loss score of the rooted tree)
+	static void getCost(GeneTree &tree, unsigned int &dup, int &loss) {
+		GeneNode *u = tree.root->child(0);
+		GeneNode *v = tree.root->child(1);
+		getCost(tree, u, u->parentno, v, v->parentno, dup, loss);
+	}
+
+	// find the rooting with the lowest cost weight * (duplications + losses)
+	// the edges are visited in the order of the recursive rerooting of earlier versions and the first of equal
+	// rootings is kept, starting with the current rooting; returns the root children (best[0] = parent side)
+	static void findBest(GeneTree &tree, const double weight, GeneNode *best[2], unsigned int &bestdup, int &bestloss) {
+		reset(tree);
+		GeneNode *u = tree.root->child(0);
+		GeneNode *v = tree.root->child(1);
+		getCost(tree, bestdup, bestloss);
+		double bestscore = bestdup * weight + bestloss * weight;
+		best[0] = u;
+		best[1] = v;
+		visit(tree, u, u->parentno, weight, best, bestscore, bestdup, bestloss);
+		visit(tree, v, v->parentno, weight, best, bestscore, bestdup, bestloss);
+	}
+
+private:
+	// neighbour i of a node, the root node is skipped (back = direction of the neighbour that points to the node)
+	static GeneNode *getNeighbour(GeneTree &tree, GeneNode *node, const int i, int &back) {
+		GeneNode *neighbour = node->direction(i);
+		if (neighbour == NULL) return NULL;
+		GeneNode *from = node;
+		if (neighbour == tree.root) {
+			from = tree.root;
+			neighbour = tree.root->child(0) == node ? tree.root->child(1) : tree.root->child(0);
+		}
+		back = 0;
+		while (neighbour->direction(back) != from) back++;
+		return neighbour;
+	}
+
+	// cost of the rooting in the edge between u and v (ku, kv = directions of the edge at u and v)
+	static void getCost(GeneTree &tree, GeneNode *u, const int ku, GeneNode *v, const int kv, unsigned int &dup, int &loss) {
+		int udup, uloss, vdup, vloss;
+		getCost(tree, u, ku, udup, uloss);
+		getCost(tree, v, kv, vdup, vloss);
+		SpeciesNode *mapping = tree.root->getMapping();
+		SpeciesNode *umapping = u->getMapping(ku);
+		SpeciesNode *vmapping = v->getMapping(kv);
+		dup = udup + vdup + (((mapping == umapping) || (mapping == vmapping)) ? 1 : 0);
+		loss = uloss + vloss + getLoss(mapping, umapping, vmapping);
+	}
+
+	// cost of the subtree of a node seen from its neighbour in direction k
+	static void getCost(GeneTree &tree, GeneNode *node, const int k, int &dup, int &loss) {
+		if (node->rootingdup[k] < 0) {
+			int d = 0, l = 0;
+			if (!node->isLeaf()) {
+				SpeciesNode *childmapping[2];
+				for (int i=0, c=0; i<3; i++) {
+					if (i == k) continue;
+					int back = 0;
+					GeneNode *child = getNeighbour(tree, node, i, back);
+					int cd, cl;
+					getCost(tree, child, back, cd, cl);
+					d += cd;
+					l += cl;
+					childmapping[c++] = child->getMapping(back);
+				}
+				SpeciesNode *mapping = node->getMapping(k);
+				if ((mapping == childmapping[0]) || (mapping == childmapping[1])) d++;
+				l += getLoss(mapping, childmapping[0], childmapping[1]);
+			}
+			node->rootingdup[k] = d;
+			node->rootingloss[k] = l;
+		}
+		dup = node->rootingdup[k];
+		loss = node->rootingloss[k];
+	}
+
+	// losses of one gene node (the same case by case evaluation as computeGeneLossForRoot)
+	static inline int getLoss(SpeciesNode *mapping, SpeciesNode *leftchild_mapping, SpeciesNode *rightchild_mapping) {
+		if ((mapping == leftchild_mapping) && (mapping == rightchild_mapping)) return 0;
+		if (mapping == leftchild_mapping) return rightchild_mapping->nodeDepth - mapping->nodeDepth;
+		if (mapping == rightchild_mapping) return leftchild_mapping->nodeDepth - mapping->nodeDepth;
+		return leftchild_mapping->nodeDepth + rightchild_mapping->nodeDepth - (2 * mapping->nodeDepth) - 2;
+	}
+
+	// rootings in the subtree of p (seen from direction k), each edge after the edges below it
+	static void visit(GeneTree &tree, GeneNode *p, const int k, const double weight, GeneNode *best[2], double &bestscore, unsigned int &bestdup, int &bestloss) {
+		for (int i=0; i<3; i++) {
+			if (i == k) continue;
+			int back;
+			GeneNode *c = getNeighbour(tree, p, i, back);
+			if (c == NULL) continue;
+			visit(tree, c, back, weight, best, bestscore, bestdup, bestloss);
+			unsigned int dup;
+			int loss;
+			getCost(tree, c, back, p, i, dup, loss);
+			const double score = dup * weight + loss * weight;
+			if (score < bestscore) {
+				bestscore = score;
+				bestdup = dup;
+				bestloss = loss;
+				best[1] = c;
+				best[0] = p;
+			}
+		}
+	}
+};
+
+#endif
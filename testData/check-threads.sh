@@ -0,0 +1,29 @@
+#!/bin/sh
+# Checks that a seed gives the same species tree with any number of threads.
+# Runs the weighted test data without --threads and with --threads 1 and 4,
+# with and without --greedy, and compares the output files byte for byte.
+#
+# usage: testData/check-threads.sh [executable]   (default ./DupLoss-2.out)
+
+EXE=${1:-./DupLoss-2.out}
+DIR=$(dirname "$0")
+INPUT="$DIR/vertebrates.weighted.newick"
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+status=0
+for seed in 1 4; do
+	for mode in "" "--greedy"; do
+		"$EXE" -i "$INPUT" -o "$TMP/threads0" --seed $seed $mode -q > /dev/null || exit 1
+		for threads in 1 4; do
+			"$EXE" -i "$INPUT" -o "$TMP/threads$threads" --seed $seed $mode --threads $threads -q > /dev/null || exit 1
+			if cmp -s "$TMP/threads0" "$TMP/threads$threads"; then
+				echo "ok      --seed $seed $mode --threads $threads"
+			else
+				echo "FAILED  --seed $seed $mode --threads $threads (differs from the run without --threads)"
+				status=1
+			fi
+		done
+	done
+done
+exit $status
@@ -0,0 +1,191 @@
+/*
+Copyright (C) 2024 Mukul S. Bansal (mukul.bansal@uconn.edu).
+Based on open-source code originally written by Andre Wehe and
+Mukul S. Bansal for the DupTree software package.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <chrono>
+
+// ------------------------------------------------------------------------------------------------------------------
+// a set of numbered tasks that can be processed by a thread pool
+class ThreadTask {
+public:
+	virtual ~ThreadTask() {}
+
+	// process task number 'task' on worker number 'worker'
+	virtual void process(const int task, const int worker) = 0;
+};
+
+// ------------------------------------------------------------------------------------------------------------------
+// a fixed set of worker threads
+// the calling thread works as worker 0, so a pool of size 1 does not start any thread
+class ThreadPool {
+protected:
+	vector<thread> threads;
+	mutex lock;
+	condition_variable wakeup, finished;
+	ThreadTask *job;
+	int ntasks;
+	atomic<int> nexttask;
+	unsigned int generation;
+	int running;
+	bool shutdown;
+
+	// work stealing: every worker has its own queue of tasks and takes tasks from the front;
+	// a worker with an empty queue steals from the back of the other queues
+	bool stealing;
+	vector<deque<int> > queues;
+	vector<mutex*> queuelocks;
+
+public:
+	// statistics per worker: time spent processing tasks (seconds), number of tasks and stolen tasks
+	vector<double> busy;
+	vector<long> tasks, stolen;
+
+	ThreadPool(const int size) {
+		job = NULL;
+		ntasks = 0;
+		nexttask = 0;
+		generation = 0;
+		running = 0;
+		shutdown = false;
+		stealing = false;
+		queues.resize(size);
+		for (int i=0; i<size; i++) queuelocks.push_back(new mutex);
+		busy.resize(size, 0);
+		tasks.resize(size, 0);
+		stolen.resize(size, 0);
+		for (int i=1; i<size; i++) threads.push_back(thread(&ThreadPool::loop, this, i));
+	}
+
+	virtual ~ThreadPool() {
+		{
+			unique_lock<mutex> guard(lock);
+			shutdown = true;
+		}
+		wakeup.notify_all();
+		for (int i=0, last=threads.size(); i<last; i++) threads[i].join();
+		for (int i=0, last=queuelocks.size(); i<last; i++) delete queuelocks[i];
+	}
+
+	// number of workers (including the calling thread)
+	inline int size() {
+		return threads.size() + 1;
+	}
+
+	// process the tasks 0..ntasks-1 and return when all of them are done
+	void run(ThreadTask &job, const int ntasks) {
+		if (ntasks <= 0) return;
+		stealing = false;
+		start(job, ntasks);
+	}
+
+	// process the tasks in 'order' with work stealing and return when all of them are done
+	// the tasks are dealt out to the worker queues in the given order (put the most expensive tasks first)
+	void run(ThreadTask &job, const vector<int> &order) {
+		if (order.empty()) return;
+		stealing = true;
+		for (int i=0, last=order.size(); i<last; i++) queues[i % size()].push_back(order[i]);
+		start(job, order.size());
+	}
+
+protected:
+	// let all workers process the tasks of a job
+	void start(ThreadTask &job, const int ntasks) {
+		this->job = &job;
+		this->ntasks = ntasks;
+		nexttask = 0;
+		if (threads.empty()) {
+			work(0);
+			this->job = NULL;
+			return;
+		}
+		{
+			unique_lock<mutex> guard(lock);
+			running = threads.size();
+			generation++;
+		}
+		wakeup.notify_all();
+		work(0);
+		unique_lock<mutex> guard(lock);
+		while (running > 0) finished.wait(guard);
+		this->job = NULL;
+	}
+
+	// get the next task of a worker (false if no task is left)
+	inline bool next(const int worker, int &task) {
+		if (!stealing) {
+			task = nexttask++;
+			return task < ntasks;
+		}
+		for (int i=0, last=size(); i<last; i++) {
+			const int victim = (worker + i) % last;
+			lock_guard<mutex> guard(*queuelocks[victim]);
+			deque<int> &queue = queues[victim];
+			if (queue.empty()) continue;
+			if (i == 0) {
+				task = queue.front();
+				queue.pop_front();
+			} else {
+				task = queue.back();
+				queue.pop_back();
+				stolen[worker]++;
+			}
+			return true;
+		}
+		return false;
+	}
+
+	// take tasks until none is left
+	inline void work(const int worker) {
+		int task;
+		const chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+		while (next(worker, task)) {
+			job->process(task, worker);
+			tasks[worker]++;
+		}
+		busy[worker] += chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+	}
+
+	// main loop of a worker thread
+	void loop(const int worker) {
+		unsigned int seen = 0;
+		for (;;) {
+			{
+				unique_lock<mutex> guard(lock);
+				while ((!shutdown) && (generation == seen)) wakeup.wait(guard);
+				if (shutdown) return;
+				seen = generation;
+			}
+			work(worker);
+			{
+				unique_lock<mutex> guard(lock);
+				running--;
+				if (running == 0) finished.notify_one();
+			}
+		}
+	}
+};
+
+#endif
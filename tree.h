@@ -365,12 +365,12 @@ public:
 				nodeorder.push_back(TempNode(i));
 
 				// pick 1st node randomly
-				int l = (int) (children[i].size() * (rand() / (RAND_MAX + 1.0)));
+				int l = input->random == NULL ? 0 : (int) (children[i].size() * input->random->uniform());
 				nodeorder[children[i][l]].parent = newid;
 				children[i].erase(children[i].begin()+l);
 
 				// pick 2nd node randomly
-				int r = (int) (children[i].size() * (rand() / (RAND_MAX + 1.0)));
+				int r = input->random == NULL ? 0 : (int) (children[i].size() * input->random->uniform());
 				nodeorder[children[i][r]].parent = newid;
 				children[i].erase(children[i].begin()+r);
 